@@ -10,6 +10,13 @@ add_compile_definitions(VMA_STATIC_VULKAN_FUNCTIONS=0)
 add_compile_definitions(VMA_DYNAMIC_VULKAN_FUNCTIONS=1)
 add_compile_definitions(VMA_VULKAN_VERSION=1001000)
 
+option(VK_ZERO_COUNT_ALLOCATIONS "Fail main if the frame loop allocates" OFF)
+if(VK_ZERO_COUNT_ALLOCATIONS)
+  add_compile_definitions(VK_ZERO_COUNT_ALLOCATIONS)
+endif()
+
+find_package(Threads REQUIRED)
+
 include(FetchContent)
 
 FetchContent_Declare(
@@ -126,8 +133,13 @@ foreach(kernel-header ${kernel-header-files})
 endforeach()
 list(APPEND kernel-headers "${CMAKE_CURRENT_SOURCE_DIR}/src/lib.h")
 file(GLOB kernels "${CMAKE_CURRENT_SOURCE_DIR}/src/bin/*.hpp")
+set(embedded-kernels-includes "")
+set(embedded-kernels-entries "")
 foreach(kernel ${kernels})
   get_filename_component(kernel ${kernel} NAME)
+  string(MAKE_C_IDENTIFIER "spirv_${kernel}" embedded-kernel)
+  string(APPEND embedded-kernels-includes "#include \"${kernel}.inl\"\n")
+  string(APPEND embedded-kernels-entries "    {\"${kernel}\", ${embedded-kernel}, sizeof(${embedded-kernel})},\n")
   if(CMAKE_SYSTEM_NAME STREQUAL Windows)
     find_program(CLSPV_WIN "clspv")
     if(CLSPV_WIN)
@@ -140,6 +152,8 @@ foreach(kernel ${kernels})
               --inline-entry-points
               --uniform-workgroup-size
               --constant-args-ubo
+              --cluster-pod-kernel-args
+              --pod-pushconstant
               -o "${kernel}"
               "bin/${kernel}"
       )
@@ -155,6 +169,8 @@ foreach(kernel ${kernels})
               --inline-entry-points
               --uniform-workgroup-size
               --constant-args-ubo
+              --cluster-pod-kernel-args
+              --pod-pushconstant
               -o "${kernel}"
               "bin/${kernel}"
       )
@@ -169,12 +185,15 @@ foreach(kernel ${kernels})
             --inline-entry-points
             --uniform-workgroup-size
             --constant-args-ubo
+            --cluster-pod-kernel-args
+            --pod-pushconstant
             -o "${kernel}"
             "bin/${kernel}"
     )
   endif()
   add_custom_command(
     OUTPUT "${CMAKE_BINARY_DIR}/${kernel}"
+           "${CMAKE_BINARY_DIR}/kernels/${kernel}.inl"
     COMMAND ${CMAKE_COMMAND} -E rm -f
                              "${CMAKE_BINARY_DIR}/${kernel}"
     COMMAND ${CLSPV_COMMAND}
@@ -187,13 +206,39 @@ foreach(kernel ${kernels})
                              "${CMAKE_BINARY_DIR}/${kernel}"
     COMMAND ${CMAKE_COMMAND} -E rm -f
                              "${CMAKE_CURRENT_SOURCE_DIR}/src/${kernel}"
+    COMMAND ${CMAKE_COMMAND} "-DEMBED_INPUT=${CMAKE_BINARY_DIR}/${kernel}"
+                             "-DEMBED_OUTPUT=${CMAKE_BINARY_DIR}/kernels/${kernel}.inl"
+                             "-DEMBED_NAME=${embedded-kernel}"
+                             -P "${CMAKE_CURRENT_SOURCE_DIR}/CMakeEmbed.cmake"
     WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}/src"
     DEPENDS "${CMAKE_CURRENT_SOURCE_DIR}/src/bin/${kernel}" ${kernel-headers}
+            "${CMAKE_CURRENT_SOURCE_DIR}/CMakeEmbed.cmake"
     VERBATIM
     COMMAND_EXPAND_LISTS
   )
-  list(APPEND clspv-kernels "${CMAKE_BINARY_DIR}/${kernel}")
+  list(APPEND clspv-kernels "${CMAKE_BINARY_DIR}/${kernel}"
+                            "${CMAKE_BINARY_DIR}/kernels/${kernel}.inl")
 endforeach()
+file(
+  CONFIGURE
+  OUTPUT "${CMAKE_BINARY_DIR}/kernels/kernels.h"
+  CONTENT "#ifndef VK_ZERO_KERNELS_H
+#define VK_ZERO_KERNELS_H
+
+${embedded-kernels-includes}
+struct EmbeddedKernel {
+    const char *name;
+    const uint32_t *code;
+    size_t size;
+};
+
+inline constexpr EmbeddedKernel EMBEDDED_KERNELS[] = {
+${embedded-kernels-entries}};
+
+#endif
+"
+  @ONLY
+)
 add_custom_target(
   clspv-target ALL
   DEPENDS ${clspv-kernels} ${kernel-headers}
@@ -202,6 +247,7 @@ add_custom_target(
 target_include_directories(vk-zero PUBLIC ${imgui_SOURCE_DIR} ${imgui_SOURCE_DIR}/backends)
 target_include_directories(vk-zero PUBLIC ${tinygltf_SOURCE_DIR})
 target_include_directories(vk-zero PUBLIC ${vma_SOURCE_DIR}/include)
+target_include_directories(vk-zero PUBLIC ${CMAKE_BINARY_DIR}/kernels)
 target_link_libraries(vk-zero PUBLIC SDL2-static)
 target_link_libraries(vk-zero PUBLIC SDL2main)
 target_link_libraries(vk-zero PUBLIC Vulkan-Headers)
@@ -209,6 +255,7 @@ target_link_libraries(vk-zero PUBLIC vk-bootstrap)
 # link_libraries(clspv)
 target_link_libraries(vk-zero PUBLIC glm)
 target_link_libraries(vk-zero PUBLIC volk)
+target_link_libraries(vk-zero PUBLIC Threads::Threads)
 
 link_libraries(vk-zero)
 add_dependencies(vk-zero clspv-target)
@@ -0,0 +1,16 @@
+file(READ "${EMBED_INPUT}" embed-content HEX)
+string(LENGTH "${embed-content}" embed-length)
+math(EXPR embed-remainder "${embed-length} % 8")
+if(embed-length EQUAL 0 OR NOT embed-remainder EQUAL 0)
+  message(FATAL_ERROR "${EMBED_INPUT} is not a sequence of 32-bit words")
+endif()
+string(
+  REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])"
+                "    0x\\4\\3\\2\\1u,\n"
+                embed-words
+                "${embed-content}"
+)
+file(
+  WRITE "${EMBED_OUTPUT}"
+  "alignas(16) inline constexpr uint32_t ${EMBED_NAME}[] = {\n${embed-words}};\n"
+)
@@ -0,0 +1,594 @@
+#include "compute_weighted_add.hpp"
+
+struct BenchWeightedAddResult {
+    uint64_t length;
+    uint3 local_size;
+    const char *memory;
+    double median, p99, bandwidth, submit;
+};
+
+int main(int argc, char *argv[]) {
+    std::string format = argc > 1 ? argv[1] : "csv";
+    auto checking = format == "jobs" || format == "chain";
+    uint64_t max_length = argc > 2   ? std::stoull(argv[2])
+                          : checking ? uint64_t{1} << 16
+                                     : uint64_t{1} << 24;
+    uint32_t iterations = argc > 3 ? std::stoul(argv[3]) : 20;
+    uint32_t warmup = 2;
+    if ((format != "csv" && format != "json" && !checking) ||
+        max_length == 0 || iterations == 0) {
+        return -1;
+    }
+    if (auto error = initialize(true)) {
+        return -1;
+    }
+    auto create_name = "bench_weighted_add";
+    vkb::Instance instance;
+    if (auto error = create_instance_headless(create_name, instance)) {
+        return -1;
+    }
+    vkb::PhysicalDevice physical_device;
+    vkb::Device device;
+    VmaAllocator allocator;
+    if (auto error = create_device_allocator(instance, VK_NULL_HANDLE,
+                                             physical_device, device,
+                                             allocator)) {
+        return -1;
+    }
+    VkQueue compute_queue;
+    uint32_t compute_queue_index;
+    if (auto error =
+            get_compute_queue(device, compute_queue, compute_queue_index)) {
+        return -1;
+    }
+    std::vector<uint32_t> queue_indices{compute_queue_index};
+    VkCommandPool compute_command_pool;
+    if (auto error = create_command_pool(device, compute_queue_index,
+                                         compute_command_pool)) {
+        return -1;
+    }
+    VkDescriptorPool descriptor_pool;
+    if (auto error = create_descriptor_pool(device, descriptor_pool)) {
+        return -1;
+    }
+    VkDescriptorSetLayout set_layout;
+    VkPipelineLayout pipeline_layout;
+    if (auto error = compute_weighted_add::create_set_pipeline_layout(
+            device, set_layout, pipeline_layout)) {
+        return -1;
+    }
+    auto module_name = "compute_weighted_add.hpp";
+    VkShaderModule shader_module;
+    if (auto error = create_shader_module(device, module_name, shader_module)) {
+        return -1;
+    }
+    auto entry_name = "compute_weighted_add_kernel";
+    auto cache_name = "bench_weighted_add.cache";
+    VkPipelineCache pipeline_cache;
+    bool pipeline_cache_hit;
+    if (auto error =
+            create_pipeline_cache(physical_device, device, cache_name,
+                                  pipeline_cache, pipeline_cache_hit)) {
+        return -1;
+    }
+    std::vector<VkFence> signal_fences;
+    if (auto error = create_fences(device, 1, signal_fences)) {
+        return -1;
+    }
+    std::vector<VkCommandBuffer> compute_command_buffers;
+    if (auto error = allocate_command_buffers(device, compute_command_pool, 1,
+                                              compute_command_buffers)) {
+        return -1;
+    }
+    auto &command_buffer = compute_command_buffers[0];
+    Profiler profiler;
+    auto profiling = !create_profiler(physical_device, device,
+                                      compute_queue_index, 16, profiler);
+    auto &limits = physical_device.properties.limits;
+    std::vector<BenchWeightedAddResult> results;
+    auto run = [&](const VkPipeline &pipeline, const uint3 &local_size,
+                   const uint64_t &length,
+                   const bool &host) -> std::optional<int> {
+        auto size = length * ELEMENT_SIZE;
+        std::array<VkBuffer, 4> buffers{};
+        std::array<VmaAllocation, 4> allocations{};
+        std::array<VmaAllocationInfo, 4> allocation_infos{};
+        std::vector<VkDescriptorSet> descriptor_sets;
+        auto destroy = [&]() {
+            if (!descriptor_sets.empty()) {
+                vkFreeDescriptorSets(device.device, descriptor_pool,
+                                     descriptor_sets.size(),
+                                     descriptor_sets.data());
+            }
+            for (auto j = 0; j < 4; ++j) {
+                if (buffers[j] != VK_NULL_HANDLE) {
+                    vmaDestroyBuffer(allocator, buffers[j], allocations[j]);
+                }
+            }
+        };
+        for (auto j = 0; j < 4; ++j) {
+            if (auto error = compute_weighted_add::create_buffer_storage(
+                    allocator, size, queue_indices, buffers[j],
+                    allocations[j], allocation_infos[j], host)) {
+                destroy();
+                return 1;
+            }
+        }
+        ComputeWeightedAddConstants constants{
+            .weights = vec4(1.f, 1.f, 1.f, 1.f),
+            .length = uvec2(length / ELEMENT_WIDTH, length % ELEMENT_WIDTH)};
+        if (auto error = compute_weighted_add::allocate_descriptor_sets(
+                device, buffers[0], allocation_infos[0], buffers[1],
+                allocation_infos[1], buffers[2], allocation_infos[2],
+                buffers[3], allocation_infos[3], 1, set_layout,
+                descriptor_pool, descriptor_sets)) {
+            destroy();
+            return -1;
+        }
+        std::vector<double> kernel_durations, submit_durations;
+        for (auto i = 0; i < warmup + iterations; ++i) {
+            if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
+                return -1;
+            }
+            VkCommandBufferBeginInfo begin_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+            if (vkBeginCommandBuffer(command_buffer, &begin_info) !=
+                VK_SUCCESS) {
+                return -1;
+            }
+            if (i == 0) {
+                for (auto j = 1; j < 4; ++j) {
+                    vkCmdFillBuffer(command_buffer, buffers[j], 0,
+                                    VK_WHOLE_SIZE, 0);
+                }
+                VkMemoryBarrier memory_barrier{
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                    .pNext = nullptr,
+                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+                vkCmdPipelineBarrier(command_buffer,
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                     1, &memory_barrier, 0, nullptr, 0,
+                                     nullptr);
+            }
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              pipeline);
+            vkCmdBindDescriptorSets(command_buffer,
+                                    VK_PIPELINE_BIND_POINT_COMPUTE,
+                                    pipeline_layout, 0, 1,
+                                    &descriptor_sets[0], 0, nullptr);
+            vkCmdPushConstants(command_buffer, pipeline_layout,
+                               VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(constants), &constants);
+            uint32_t region;
+            if (profiling) {
+                profiler_begin(profiler, command_buffer,
+                               "compute_weighted_add_kernel", size * 4,
+                               region);
+            }
+            vkCmdDispatch(command_buffer,
+                          length / (local_size.x * local_size.y) + 1, 1, 1);
+            if (profiling) {
+                profiler_end(profiler, command_buffer, region);
+            }
+            if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+                return -1;
+            }
+            if (vkResetFences(device.device, 1, &signal_fences[0]) !=
+                VK_SUCCESS) {
+                return -1;
+            }
+            VkSubmitInfo submit_info = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &command_buffer};
+            auto submit_begin = std::chrono::steady_clock::now();
+            if (vkQueueSubmit(compute_queue, 1, &submit_info,
+                              signal_fences[0]) != VK_SUCCESS) {
+                return -1;
+            }
+            if (profiling) {
+                profiler_submit(profiler, signal_fences[0]);
+            }
+            if (vkWaitForFences(device.device, 1, &signal_fences[0], VK_TRUE,
+                                UINT64_MAX) != VK_SUCCESS) {
+                return -1;
+            }
+            auto wall = std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - submit_begin)
+                            .count();
+            auto kernel = wall;
+            if (profiling) {
+                if (auto error = profiler_resolve(device, profiler)) {
+                    return -1;
+                }
+                if (!profiler.results.empty()) {
+                    kernel = profiler.results.back().duration;
+                }
+                profiler.results.clear();
+            }
+            if (i >= warmup) {
+                kernel_durations.push_back(kernel);
+                submit_durations.push_back(std::max(wall - kernel, 0.));
+            }
+        }
+        destroy();
+        std::sort(kernel_durations.begin(), kernel_durations.end());
+        std::sort(submit_durations.begin(), submit_durations.end());
+        auto median = kernel_durations[iterations / 2];
+        auto p99 = kernel_durations[std::min<size_t>(
+            iterations - 1, (iterations * 99 + 99) / 100 - 1)];
+        results.push_back({length, local_size, host ? "host" : "device",
+                           median, p99,
+                           median > 0. ? size * 4 / median / 1e3 : 0.,
+                           submit_durations[iterations / 2]});
+        return {};
+    };
+    auto jobs = [&](const uint64_t &length,
+                    const uint32_t &count) -> std::optional<int> {
+        auto local_size = uvec3(64, 1, 1);
+        auto size = length * ELEMENT_SIZE;
+        VkPipeline pipeline;
+        if (auto error = create_pipeline(device, pipeline_cache,
+                                         pipeline_layout, shader_module,
+                                         local_size, entry_name, pipeline)) {
+            return -1;
+        }
+        compute_weighted_add::JobQueue job_queue;
+        if (auto error = compute_weighted_add::create_job_queue(
+                physical_device, device, compute_queue_index,
+                compute_command_pool, local_size, 2, 4, job_queue)) {
+            return -1;
+        }
+        auto alignment = get_arena_alignment(physical_device);
+        Arena arena;
+        if (auto error = create_arena(
+                physical_device, allocator,
+                count * 4 * ((size + alignment - 1) / alignment * alignment),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, queue_indices, true,
+                arena)) {
+            return -1;
+        }
+        auto data =
+            static_cast<float4 *>(arena.allocation_info.pMappedData);
+        auto at = [&](const uint32_t &offset) {
+            return reinterpret_cast<ComputeWeightedAddElement *>(data +
+                                                                 offset);
+        };
+        std::vector<compute_weighted_add::WeightedAddJob> pushed(count);
+        std::vector<uint64_t> tickets(count);
+        for (uint32_t j = 0; j < count; ++j) {
+            auto &job = pushed[j];
+            if (auto error = compute_weighted_add::arena_allocate_job(
+                    arena, length, vec4(.5f, 1.f, 2.f, float(j % 3)), job)) {
+                return -1;
+            }
+            for (uint64_t i = 0; i < length; ++i) {
+                data[job.offsets.y + i] = vec4(float(i % 7 + j));
+                data[job.offsets.z + i] = vec4(float(i % 5));
+                data[job.offsets.w + i] = vec4(float(i % 3) - 1.f);
+            }
+            if (j % 2) {
+                job.offsets.y = pushed[j - 1].offsets.x;
+            }
+            if (auto error = compute_weighted_add::job_queue_push(
+                    device, compute_queue, pipeline, pipeline_layout,
+                    set_layout, descriptor_pool, job_queue, job,
+                    tickets[j])) {
+                return -1;
+            }
+        }
+        if (auto error = compute_weighted_add::job_queue_flush(
+                device, compute_queue, pipeline, pipeline_layout, set_layout,
+                descriptor_pool, job_queue)) {
+            return -1;
+        }
+        for (auto &ticket : tickets) {
+            if (auto error = compute_weighted_add::job_queue_wait(
+                    device, job_queue, ticket)) {
+                return -1;
+            }
+        }
+        auto elements = (length + ELEMENT_WIDTH - 1) / ELEMENT_WIDTH;
+        std::vector<ComputeWeightedAddElement> previous(elements),
+            expected(elements);
+        for (uint32_t j = 0; j < count; ++j) {
+            auto &job = pushed[j];
+            compute_weighted_add::weighted_add_host(
+                job.weights, expected.data(),
+                j % 2 ? previous.data() : at(job.offsets.y),
+                at(job.offsets.z), at(job.offsets.w), length);
+            uint64_t mismatch;
+            if (auto error = compute_weighted_add::compare_host(
+                    at(job.offsets.x), expected.data(), length, mismatch)) {
+                std::cout << "jobs: mismatch in job " << j << " at "
+                          << mismatch << "\n";
+                return -1;
+            }
+            std::swap(previous, expected);
+        }
+        std::cout << "jobs: ok, " << count << " jobs in "
+                  << job_queue.submitted << " batches\n";
+        for (auto &job : pushed) {
+            compute_weighted_add::arena_free_job(arena, job);
+        }
+        compute_weighted_add::release_job_descriptor_sets(
+            device, descriptor_pool, job_queue, arena.buffer);
+        compute_weighted_add::destroy_job_queue(device, compute_command_pool,
+                                                descriptor_pool, job_queue);
+        destroy_arena(allocator, arena);
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+        return {};
+    };
+    auto chain = [&](const uint64_t &length) -> std::optional<int> {
+        auto local_size = uvec3(64, 1, 1);
+        auto size = length * ELEMENT_SIZE;
+        if (size > limits.maxStorageBufferRange ||
+            length / local_size.x + 1 > limits.maxComputeWorkGroupCount[0]) {
+            return -1;
+        }
+        auto chain_name = "compute_weighted_add_chain_kernel";
+        VkPipeline pipeline, chain_pipeline;
+        if (auto error = create_pipeline(device, pipeline_cache,
+                                         pipeline_layout, shader_module,
+                                         local_size, entry_name, pipeline)) {
+            return -1;
+        }
+        if (auto error = create_pipeline(
+                device, pipeline_cache, pipeline_layout, shader_module,
+                local_size, chain_name, chain_pipeline)) {
+            return -1;
+        }
+        auto alignment = get_arena_alignment(physical_device);
+        Arena arena;
+        if (auto error = create_arena(
+                physical_device, allocator,
+                6 * ((size + alignment - 1) / alignment * alignment),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, queue_indices, true,
+                arena)) {
+            return -1;
+        }
+        std::array<uint32_t, 6> offsets;
+        for (auto &offset : offsets) {
+            VkDeviceSize byte_offset;
+            if (auto error = arena_allocate(arena, size, byte_offset)) {
+                return -1;
+            }
+            if (byte_offset / ELEMENT_SIZE > UINT32_MAX) {
+                return -1;
+            }
+            offset = byte_offset / ELEMENT_SIZE;
+        }
+        auto &[a, t, u, b, c, d] = offsets;
+        auto data =
+            static_cast<float4 *>(arena.allocation_info.pMappedData);
+        auto at = [&](const uint32_t &offset) {
+            return reinterpret_cast<ComputeWeightedAddElement *>(data +
+                                                                 offset);
+        };
+        for (uint64_t i = 0; i < length; ++i) {
+            data[b + i] = vec4(float(i % 7));
+            data[c + i] = vec4(float(i % 5));
+            data[d + i] = vec4(float(i % 3) - 1.f);
+        }
+        std::vector<VkDescriptorSet> descriptor_sets;
+        if (auto error = compute_weighted_add::allocate_descriptor_sets(
+                device, arena.buffer, arena.allocation_info, arena.buffer,
+                arena.allocation_info, arena.buffer, arena.allocation_info,
+                arena.buffer, arena.allocation_info, 1, set_layout,
+                descriptor_pool, descriptor_sets)) {
+            return -1;
+        }
+        auto first = vec4(.5f, 1.f, 2.f, -1.f);
+        auto second = vec4(2.f, .25f, 1.f, .5f);
+        auto count = uvec2(length / ELEMENT_WIDTH, length % ELEMENT_WIDTH);
+        ComputeWeightedAddChainConstants chain_constants{
+            .weights = {first, second},
+            .offsets = uvec4(a, b, c, d),
+            .length = count};
+        std::array<ComputeWeightedAddConstants, 2> stage_constants{
+            ComputeWeightedAddConstants{.weights = first,
+                                        .offsets = uvec4(t, b, c, d),
+                                        .length = count},
+            ComputeWeightedAddConstants{.weights = second,
+                                        .offsets = uvec4(u, t, c, d),
+                                        .length = count}};
+        auto groups = length / local_size.x + 1;
+        if (vkResetFences(device.device, 1, &signal_fences[0]) != VK_SUCCESS ||
+            vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
+            return -1;
+        }
+        VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            return -1;
+        }
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                pipeline_layout, 0, 1, &descriptor_sets[0], 0,
+                                nullptr);
+        uint32_t region;
+        if (profiling) {
+            profiler_begin(profiler, command_buffer, "fused", size * 4,
+                           region);
+        }
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          chain_pipeline);
+        vkCmdPushConstants(command_buffer, pipeline_layout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(chain_constants), &chain_constants);
+        vkCmdDispatch(command_buffer, groups, 1, 1);
+        if (profiling) {
+            profiler_end(profiler, command_buffer, region);
+            profiler_begin(profiler, command_buffer, "unfused", size * 8,
+                           region);
+        }
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pipeline);
+        VkMemoryBarrier memory_barrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+        for (auto &constants : stage_constants) {
+            if (&constants != &stage_constants[0]) {
+                vkCmdPipelineBarrier(command_buffer,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                     1, &memory_barrier, 0, nullptr, 0,
+                                     nullptr);
+            }
+            vkCmdPushConstants(command_buffer, pipeline_layout,
+                               VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(constants), &constants);
+            vkCmdDispatch(command_buffer, groups, 1, 1);
+        }
+        if (profiling) {
+            profiler_end(profiler, command_buffer, region);
+        }
+        memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memory_barrier,
+                             0, nullptr, 0, nullptr);
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            return -1;
+        }
+        VkSubmitInfo submit_info = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                                    .commandBufferCount = 1,
+                                    .pCommandBuffers = &command_buffer};
+        if (vkQueueSubmit(compute_queue, 1, &submit_info, signal_fences[0]) !=
+            VK_SUCCESS) {
+            return -1;
+        }
+        if (profiling) {
+            profiler_submit(profiler, signal_fences[0]);
+        }
+        if (vkWaitForFences(device.device, 1, &signal_fences[0], VK_TRUE,
+                            UINT64_MAX) != VK_SUCCESS) {
+            return -1;
+        }
+        std::vector<ComputeWeightedAddElement> expected(
+            (length + ELEMENT_WIDTH - 1) / ELEMENT_WIDTH);
+        compute_weighted_add::weighted_add_chain_host(
+            first, second, expected.data(), at(b), at(c), at(d), length);
+        uint64_t mismatch;
+        if (auto error = compute_weighted_add::compare_host(at(a), at(u),
+                                                            length, mismatch)) {
+            std::cout << "chain: fused and unfused differ at " << mismatch
+                      << "\n";
+            return -1;
+        }
+        if (auto error = compute_weighted_add::compare_host(
+                at(a), expected.data(), length, mismatch)) {
+            std::cout << "chain: mismatch at " << mismatch << "\n";
+            return -1;
+        }
+        std::cout << "chain: ok";
+        if (profiling) {
+            if (auto error = profiler_resolve(device, profiler)) {
+                return -1;
+            }
+            for (auto &result : profiler.results) {
+                std::cout << ", " << result.name << " " << result.duration
+                          << " us";
+            }
+            profiler.results.clear();
+        }
+        std::cout << "\n";
+        vkFreeDescriptorSets(device.device, descriptor_pool,
+                             descriptor_sets.size(), descriptor_sets.data());
+        destroy_arena(allocator, arena);
+        vkDestroyPipeline(device.device, chain_pipeline, nullptr);
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+        return {};
+    };
+    if (format == "jobs") {
+        if (auto error = jobs(max_length, iterations)) {
+            return -1;
+        }
+    } else if (format == "chain") {
+        if (auto error = chain(max_length)) {
+            return -1;
+        }
+    }
+    std::vector<uint3> local_sizes{uvec3(64, 1, 1), uvec3(256, 1, 1),
+                                   uvec3(16, 16, 1), uvec3(16, 32, 1),
+                                   uvec3(32, 32, 1)};
+    for (auto &local_size : local_sizes) {
+        if (checking ||
+            local_size.x * local_size.y * local_size.z >
+                limits.maxComputeWorkGroupInvocations ||
+            local_size.x > limits.maxComputeWorkGroupSize[0] ||
+            local_size.y > limits.maxComputeWorkGroupSize[1]) {
+            continue;
+        }
+        VkPipeline pipeline;
+        if (auto error = create_pipeline(device, pipeline_cache,
+                                         pipeline_layout, shader_module,
+                                         local_size, entry_name, pipeline)) {
+            return -1;
+        }
+        for (uint64_t length = 1024; length <= max_length; length *= 4) {
+            if (length * ELEMENT_SIZE > limits.maxStorageBufferRange ||
+                length / (local_size.x * local_size.y) + 1 >
+                    limits.maxComputeWorkGroupCount[0]) {
+                break;
+            }
+            for (auto host : {false, true}) {
+                if (auto error = run(pipeline, local_size, length, host);
+                    error && error.value() < 0) {
+                    return -1;
+                }
+            }
+        }
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+    }
+    if (format == "csv") {
+        std::cout << "length,bytes,local_size_x,local_size_y,memory,median_us,"
+                     "p99_us,gbps,submit_us\n";
+        for (auto &result : results) {
+            std::cout << result.length << ","
+                      << result.length * ELEMENT_SIZE * 4 << ","
+                      << result.local_size.x << "," << result.local_size.y
+                      << "," << result.memory << "," << result.median << ","
+                      << result.p99 << "," << result.bandwidth << ","
+                      << result.submit << "\n";
+        }
+    } else if (format == "json") {
+        std::cout << "[";
+        for (auto i = 0; i < results.size(); ++i) {
+            auto &result = results[i];
+            std::cout << (i ? ",\n" : "\n") << "{\"length\":" << result.length
+                      << ",\"bytes\":" << result.length * ELEMENT_SIZE * 4
+                      << ",\"local_size\":[" << result.local_size.x << ","
+                      << result.local_size.y << "],\"memory\":\""
+                      << result.memory << "\",\"median_us\":" << result.median
+                      << ",\"p99_us\":" << result.p99
+                      << ",\"gbps\":" << result.bandwidth
+                      << ",\"submit_us\":" << result.submit << "}";
+        }
+        std::cout << "\n]\n";
+    }
+    if (profiling) {
+        destroy_profiler(device, profiler);
+    }
+    vkFreeCommandBuffers(device.device, compute_command_pool,
+                         compute_command_buffers.size(),
+                         compute_command_buffers.data());
+    for (auto &fence : signal_fences) {
+        vkDestroyFence(device.device, fence, nullptr);
+    }
+    destroy_pipeline_cache(device, cache_name, pipeline_cache);
+    vkDestroyShaderModule(device.device, shader_module, nullptr);
+    vkDestroyPipelineLayout(device.device, pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(device.device, set_layout, nullptr);
+    vkDestroyDescriptorPool(device.device, descriptor_pool, nullptr);
+    vkDestroyCommandPool(device.device, compute_command_pool, nullptr);
+    vmaDestroyAllocator(allocator);
+    vkb::destroy_device(device);
+    vkb::destroy_instance(instance);
+    return 0;
+}
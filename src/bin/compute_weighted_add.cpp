@@ -1,34 +1,93 @@
-#include "compute_weighted_add.h"
+#include "compute_weighted_add.hpp"
 
 int main(int argc, char *argv[]) {
-    if (auto error = initialize()) {
+    uint64_t length = argc > 1 ? std::stoull(argv[1]) : 16384;
+    if (length <= 4094 || (argc > 2 && argc != 6)) {
         return -1;
     }
+    std::vector<ComputeWeightedAddElement> host_a, host_b, host_c, host_d;
+    std::array<ComputeWeightedAddElement *, 4> storages;
+    std::array<MappedFile, 4> files;
+    auto mapped = argc == 6;
+    if (mapped) {
+        for (auto i = 0; i < 4; ++i) {
+            if (auto error = map_file(argv[i == 0 ? 5 : i + 1],
+                                      length * ELEMENT_SIZE, i == 0,
+                                      files[i])) {
+                return -1;
+            }
+            storages[i] =
+                static_cast<ComputeWeightedAddElement *>(files[i].data);
+        }
+    } else {
+        auto i = 0;
+        for (auto storage : {&host_a, &host_b, &host_c, &host_d}) {
+            storage->resize((length + ELEMENT_WIDTH - 1) / ELEMENT_WIDTH);
+            memset(storage->data(), 0,
+                   storage->size() * sizeof(ComputeWeightedAddElement));
+            storages[i++] = storage->data();
+        }
+        ((float4 *)storages[1])[4094] = vec4(.5f);
+    }
+    auto pointer_a = (float4 *)storages[0];
+    float4 weights = vec4(1.f, 1.f, 1.f, 1.f);
+    auto host = [&]() -> int {
+        std::vector<ComputeWeightedAddElement> serial(
+            (length + ELEMENT_WIDTH - 1) / ELEMENT_WIDTH);
+        compute_weighted_add::weighted_add_host(weights, serial.data(),
+                                                storages[1], storages[2],
+                                                storages[3], length);
+        ComputeWeightedAddConstants constants{
+            .weights = weights,
+            .offsets = uvec4(0, 0, 0, 0),
+            .length = uvec2(length / ELEMENT_WIDTH, length % ELEMENT_WIDTH)};
+        uint3 host_local_size = uvec3(1, 256, 1);
+        if (auto error = dispatch(
+                compute_weighted_add_kernel,
+                uvec3((length + host_local_size.y - 1) / host_local_size.y,
+                      host_local_size.y, 1),
+                host_local_size, storages[0], storages[1], storages[2],
+                storages[3], constants)) {
+            return -1;
+        }
+        uint64_t mismatch;
+        if (auto error = compute_weighted_add::compare_host(
+                storages[0], serial.data(), length, mismatch)) {
+            std::cout << "dispatch mismatch: " << mismatch << "\n";
+            return -1;
+        }
+        auto &element = pointer_a[4094];
+        std::cout << element.x << " " << element.y << " " << element.z << " "
+                  << element.w << "\n";
+        return 0;
+    };
+    if (auto error = initialize(true)) {
+        return host();
+    }
     auto create_name = "compute_weighted_add";
-    SDL_Window *window;
     vkb::Instance instance;
-    VkSurfaceKHR surface;
-    if (auto error = create_window_instance_surface(create_name, window,
-                                                    instance, surface)) {
-        return -1;
+    if (auto error = create_instance_headless(create_name, instance)) {
+        return host();
     }
     vkb::PhysicalDevice physical_device;
     vkb::Device device;
     VmaAllocator allocator;
-    if (auto error = create_device_allocator(instance, surface, physical_device,
-                                             device, allocator)) {
-        return -1;
+    if (auto error = create_device_allocator(instance, VK_NULL_HANDLE,
+                                             physical_device, device,
+                                             allocator)) {
+        return host();
     }
-    VkQueue graphics_queue, compute_queue;
-    uint32_t graphics_queue_index, compute_queue_index;
-    if (auto error = get_graphics_compute_queue(
-            device, graphics_queue, graphics_queue_index, compute_queue,
-            compute_queue_index)) {
+    VkQueue compute_queue;
+    uint32_t compute_queue_index;
+    if (auto error =
+            get_compute_queue(device, compute_queue, compute_queue_index)) {
         return -1;
     }
-    VkCommandPool graphics_command_pool;
-    if (auto error = create_command_pool(device, graphics_queue_index,
-                                         graphics_command_pool)) {
+    VkQueue transfer_queue;
+    uint32_t transfer_queue_index;
+    if (auto error = get_transfer_queue(device, compute_queue,
+                                        compute_queue_index, transfer_queue,
+                                        transfer_queue_index)) {
         return -1;
     }
     VkCommandPool compute_command_pool;
@@ -40,59 +99,6 @@ int main(int argc, char *argv[]) {
     if (auto error = create_descriptor_pool(device, descriptor_pool)) {
         return -1;
     }
-    uint64_t length = 16384;
-    VkBuffer buffer_storage_a;
-    VmaAllocation allocation_storage_a;
-    VmaAllocationInfo allocation_info_storage_a;
-    if (auto error = compute_weighted_add::create_buffer_storage(
-            allocator, length * ELEMENT_SIZE, buffer_storage_a,
-            allocation_storage_a, allocation_info_storage_a)) {
-        return -1;
-    }
-    auto pointer_a = (float4 *)allocation_info_storage_a.pMappedData;
-    VkBuffer buffer_storage_b;
-    VmaAllocation allocation_storage_b;
-    VmaAllocationInfo allocation_info_storage_b;
-    if (auto error = compute_weighted_add::create_buffer_storage(
-            allocator, length * ELEMENT_SIZE, buffer_storage_b,
-            allocation_storage_b, allocation_info_storage_b)) {
-        return -1;
-    }
-    auto pointer_b = (float4 *)allocation_info_storage_b.pMappedData;
-    pointer_b[4094] = vec4(.5f);
-    VkBuffer buffer_storage_c;
-    VmaAllocation allocation_storage_c;
-    VmaAllocationInfo allocation_info_storage_c;
-    if (auto error = compute_weighted_add::create_buffer_storage(
-            allocator, length * ELEMENT_SIZE, buffer_storage_c,
-            allocation_storage_c, allocation_info_storage_c)) {
-        return -1;
-    }
-    auto pointer_c = (float4 *)allocation_info_storage_c.pMappedData;
-    VkBuffer buffer_storage_d;
-    VmaAllocation allocation_storage_d;
-    VmaAllocationInfo allocation_info_storage_d;
-    if (auto error = compute_weighted_add::create_buffer_storage(
-            allocator, length * ELEMENT_SIZE, buffer_storage_d,
-            allocation_storage_d, allocation_info_storage_d)) {
-        return -1;
-    }
-    auto pointer_d = (float4 *)allocation_info_storage_d.pMappedData;
-    ComputeWeightedAddConstants constants{
-        .weights = vec4(1.f, 1.f, 1.f, 1.f),
-        .length = uvec2(length / ELEMENT_WIDTH, length % ELEMENT_WIDTH)};
-    if (constants.length.y > 0) {
-        constants.length.x += 1;
-    }
-    VkBuffer buffer_uniform;
-    VmaAllocation allocation_uniform;
-    VmaAllocationInfo allocation_info_uniform;
-    if (auto error = create_buffer_uniform(allocator, sizeof(constants),
-                                           buffer_uniform, allocation_uniform,
-                                           allocation_info_uniform)) {
-        return -1;
-    }
-    memcpy(allocation_info_uniform.pMappedData, &constants, sizeof(constants));
     VkDescriptorSetLayout set_layout;
     VkPipelineLayout pipeline_layout;
     if (auto error = compute_weighted_add::create_set_pipeline_layout(
@@ -106,138 +112,182 @@ int main(int argc, char *argv[]) {
         return -1;
     }
     auto entry_name = "compute_weighted_add_kernel";
-    VkPipeline pipeline;
-    if (auto error = create_pipeline(device, pipeline_layout, shader_module,
-                                     local_size, entry_name, pipeline)) {
-        return -1;
-    }
-    vkb::Swapchain swapchain;
-    std::vector<VkImage> images;
-    std::vector<VkImageView> image_views;
-    std::vector<VkFence> signal_fences;
-    std::vector<VkSemaphore> wait_semaphores, signal_semaphores;
-    std::vector<VkFence> wait_fences;
-    std::vector<VkFramebuffer> framebuffers;
-    VkRenderPass render_pass;
+    auto cache_name = "compute_weighted_add.cache";
+    VkPipelineCache pipeline_cache;
+    bool pipeline_cache_hit;
     if (auto error =
-            create_swapchain_semaphores_fences_render_pass_framebuffers(
-                device, swapchain, images, image_views, signal_fences,
-                wait_semaphores, signal_semaphores, render_pass,
-                framebuffers)) {
+            create_pipeline_cache(physical_device, device, cache_name,
+                                  pipeline_cache, pipeline_cache_hit)) {
         return -1;
     }
-    std::vector<VkDescriptorSet> descriptor_sets;
-    if (auto error = compute_weighted_add::allocate_descriptor_sets(
-            device, buffer_storage_a, allocation_info_storage_a,
-            buffer_storage_b, allocation_info_storage_b, buffer_storage_c,
-            allocation_info_storage_c, buffer_storage_d,
-            allocation_info_storage_d, buffer_uniform, allocation_info_uniform,
-            swapchain, image_views, set_layout, descriptor_pool,
-            descriptor_sets)) {
+    Profiler profiler;
+    auto profiling = !create_profiler(physical_device, device,
+                                      compute_queue_index, 256, profiler);
+    Tuning tuning;
+    auto tuning_bucket = get_tuning_bucket(length);
+    if (auto error = load_tuning(physical_device, tuning)) {
         return -1;
     }
-    std::vector<VkCommandBuffer> graphics_command_buffers;
-    if (auto error = allocate_command_buffers(
-            window, device, graphics_queue_index, graphics_command_pool,
-            swapchain, graphics_command_buffers)) {
-        return -1;
+    if (std::getenv("VK_ZERO_AUTOTUNE")) {
+        std::vector<uint3> candidates;
+        get_local_size_candidates(physical_device, 2, candidates);
+        auto minimum = *std::min_element(
+            candidates.begin(), candidates.end(),
+            [](const uint3 &a, const uint3 &b) {
+                return a.x * a.y < b.x * b.y;
+            });
+        compute_weighted_add::StreamingExecutor tuning_executor;
+        if (auto error = compute_weighted_add::create_streaming_executor(
+                physical_device, device, allocator, compute_queue_index,
+                transfer_queue_index, compute_command_pool, descriptor_pool,
+                set_layout, minimum, 3, std::min<uint64_t>(length, 1 << 22),
+                tuning_executor)) {
+            return -1;
+        }
+        double duration;
+        if (auto error = autotune_local_size(
+                candidates,
+                [&](const uint3 &candidate,
+                    double &candidate_duration) -> std::optional<int> {
+                    VkPipeline candidate_pipeline;
+                    if (auto error = create_pipeline(
+                            device, pipeline_cache, pipeline_layout,
+                            shader_module, candidate, entry_name,
+                            candidate_pipeline)) {
+                        return -1;
+                    }
+                    candidate_duration =
+                        std::numeric_limits<double>::infinity();
+                    for (auto i = 0; i < 3; ++i) {
+                        profiler.results.clear();
+                        auto begin = std::chrono::steady_clock::now();
+                        if (auto error =
+                                compute_weighted_add::stream_weighted_add(
+                                    device, compute_queue, transfer_queue,
+                                    candidate_pipeline, pipeline_layout,
+                                    candidate, tuning_executor, weights,
+                                    pointer_a, (float4 *)storages[1],
+                                    (float4 *)storages[2],
+                                    (float4 *)storages[3],
+                                    tuning_executor.chunk_length,
+                                    profiling ? &profiler : nullptr)) {
+                            return -1;
+                        }
+                        double sample =
+                            std::chrono::duration<double, std::micro>(
+                                std::chrono::steady_clock::now() - begin)
+                                .count();
+                        if (!profiler.results.empty()) {
+                            sample = 0.;
+                            for (auto &result : profiler.results) {
+                                sample += result.duration;
+                            }
+                        }
+                        candidate_duration =
+                            std::min(candidate_duration, sample);
+                    }
+                    profiler.results.clear();
+                    vkDestroyPipeline(device.device, candidate_pipeline,
+                                      nullptr);
+                    return {};
+                },
+                local_size, duration)) {
+            return -1;
+        }
+        compute_weighted_add::destroy_streaming_executor(
+            device, allocator, compute_command_pool, descriptor_pool,
+            tuning_executor);
+        update_tuning(tuning, entry_name, tuning_bucket, local_size, duration);
+        if (auto error = save_tuning(tuning)) {
+            return -1;
+        }
+    } else {
+        find_tuning(tuning, entry_name, tuning_bucket, local_size);
     }
-    std::vector<VkCommandBuffer> compute_command_buffers;
-    if (auto error = allocate_command_buffers(
-            window, device, compute_queue_index, compute_command_pool,
-            swapchain, compute_command_buffers)) {
+    std::cout << "local size: " << local_size.x << "x" << local_size.y << "x"
+              << local_size.z << "\n";
+    auto pipeline_begin = std::chrono::steady_clock::now();
+    VkPipeline pipeline;
+    if (auto error =
+            create_pipeline(device, pipeline_cache, pipeline_layout,
+                            shader_module, local_size, entry_name, pipeline)) {
         return -1;
     }
-    uint32_t image_index = 0;
-    if (vkWaitForFences(device.device, 1, &signal_fences[image_index], VK_TRUE,
-                        UINT64_MAX) != VK_SUCCESS) {
+    std::cout << "pipeline cache " << (pipeline_cache_hit ? "hit" : "miss")
+              << ": "
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - pipeline_begin)
+                     .count()
+              << " ms\n";
+    compute_weighted_add::StreamingExecutor executor;
+    if (auto error = compute_weighted_add::create_streaming_executor(
+            physical_device, device, allocator, compute_queue_index,
+            transfer_queue_index, compute_command_pool, descriptor_pool,
+            set_layout, local_size, 3, length, executor)) {
         return -1;
     }
-    if (vkResetFences(device.device, 1, &signal_fences[image_index]) !=
-        VK_SUCCESS) {
-        return -1;
+    std::array<HostImport, 3> imports;
+    uint32_t imported = 0;
+    for (auto i = 0; mapped && i < 3; ++i) {
+        if (auto error = create_host_import(physical_device, device,
+                                            files[i + 1],
+                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                            imports[i])) {
+            continue;
+        }
+        ++imported;
     }
-    if (vkResetCommandBuffer(compute_command_buffers[image_index],
-                             VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT) !=
-        VK_SUCCESS) {
-        return -1;
+    if (mapped) {
+        std::cout << "host import: " << imported << "/3\n";
     }
-    VkCommandBufferBeginInfo begin_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
-    if (vkBeginCommandBuffer(compute_command_buffers[image_index],
-                             &begin_info) != VK_SUCCESS) {
+    if (auto error = compute_weighted_add::stream_weighted_add(
+            device, compute_queue, transfer_queue, pipeline, pipeline_layout,
+            local_size, executor, weights, pointer_a,
+            (float4 *)storages[1], (float4 *)storages[2],
+            (float4 *)storages[3], length, profiling ? &profiler : nullptr,
+            [&](const uint64_t &first, const uint64_t &chunk_length) {
+                if (first <= 4094 && 4094 < first + chunk_length) {
+                    auto &element = pointer_a[4094];
+                    std::cout << element.x << " " << element.y << " "
+                              << element.z << " " << element.w << "\n";
+                }
+            },
+            &imports)) {
         return -1;
     }
-    vkCmdBindPipeline(compute_command_buffers[image_index],
-                      VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-    vkCmdBindDescriptorSets(compute_command_buffers[image_index],
-                            VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0,
-                            1, &descriptor_sets[image_index], 0, nullptr);
-    vkCmdDispatch(compute_command_buffers[image_index],
-                  length / (local_size.x * local_size.y) + 1, 1, 1);
-    if (vkEndCommandBuffer(compute_command_buffers[image_index]) !=
-        VK_SUCCESS) {
-        return -1;
+    for (auto &import : imports) {
+        if (import.buffer != VK_NULL_HANDLE) {
+            destroy_host_import(device, import);
+        }
     }
-    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT};
-    VkSubmitInfo submit_info = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                                .waitSemaphoreCount = 0,
-                                .pWaitSemaphores = nullptr,
-                                .pWaitDstStageMask = wait_stages,
-                                .commandBufferCount = 1,
-                                .pCommandBuffers =
-                                    &compute_command_buffers[image_index],
-                                .signalSemaphoreCount = 0,
-                                .pSignalSemaphores = nullptr};
-    if (vkQueueSubmit(compute_queue, 1, &submit_info,
-                      signal_fences[image_index]) != VK_SUCCESS) {
-        return -1;
+    if (profiling) {
+        double duration = 0.;
+        uint64_t bytes = 0;
+        for (auto &result : profiler.results) {
+            duration += result.duration;
+            bytes += result.bytes;
+        }
+        std::cout << "kernel: " << duration / 1e3 << " ms, "
+                  << (duration > 0. ? bytes / duration / 1e3 : 0.)
+                  << " GB/s\n";
+        auto trace_name = "compute_weighted_add.trace.json";
+        profiler_export(profiler, trace_name);
+        destroy_profiler(device, profiler);
     }
-    vkDeviceWaitIdle(device.device);
-    auto &element = pointer_a[4094];
-    std::cout << element.x << " " << element.y << " " << element.z << " "
-              << element.w << "\n";
-    vkFreeCommandBuffers(device.device, compute_command_pool,
-                         compute_command_buffers.size(),
-                         compute_command_buffers.data());
-    vkFreeCommandBuffers(device.device, graphics_command_pool,
-                         graphics_command_buffers.size(),
-                         graphics_command_buffers.data());
-    vkFreeDescriptorSets(device.device, descriptor_pool, descriptor_sets.size(),
-                         descriptor_sets.data());
-    for (auto &framebuffer : framebuffers) {
-        vkDestroyFramebuffer(device.device, framebuffer, nullptr);
-    }
-    vkDestroyRenderPass(device.device, render_pass, nullptr);
-    for (auto &semaphore : signal_semaphores) {
-        vkDestroySemaphore(device.device, semaphore, nullptr);
-    }
-    for (auto &semaphore : wait_semaphores) {
-        vkDestroySemaphore(device.device, semaphore, nullptr);
-    }
-    for (auto &fence : signal_fences) {
-        vkDestroyFence(device.device, fence, nullptr);
-    }
-    swapchain.destroy_image_views(image_views);
-    vkb::destroy_swapchain(swapchain);
+    compute_weighted_add::destroy_streaming_executor(
+        device, allocator, compute_command_pool, descriptor_pool, executor);
     vkDestroyPipeline(device.device, pipeline, nullptr);
+    destroy_pipeline_cache(device, cache_name, pipeline_cache);
     vkDestroyShaderModule(device.device, shader_module, nullptr);
     vkDestroyPipelineLayout(device.device, pipeline_layout, nullptr);
     vkDestroyDescriptorSetLayout(device.device, set_layout, nullptr);
-    vmaDestroyBuffer(allocator, buffer_uniform, allocation_uniform);
-    vmaDestroyBuffer(allocator, buffer_storage_d, allocation_storage_d);
-    vmaDestroyBuffer(allocator, buffer_storage_c, allocation_storage_c);
-    vmaDestroyBuffer(allocator, buffer_storage_b, allocation_storage_b);
-    vmaDestroyBuffer(allocator, buffer_storage_a, allocation_storage_a);
     vkDestroyDescriptorPool(device.device, descriptor_pool, nullptr);
     vkDestroyCommandPool(device.device, compute_command_pool, nullptr);
-    vkDestroyCommandPool(device.device, graphics_command_pool, nullptr);
     vmaDestroyAllocator(allocator);
     vkb::destroy_device(device);
-    vkDestroySurfaceKHR(instance.instance, surface, nullptr);
     vkb::destroy_instance(instance);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    for (auto i = 0; mapped && i < 4; ++i) {
+        unmap_file(files[i]);
+    }
     return 0;
 }
@@ -18,34 +18,35 @@ constexpr uint64_t ELEMENT_SIZE = sizeof(float4);
 
 struct ComputeWeightedAddConstants {
     float4 weights;
+    uint4 offsets;
+    uint2 length;
+};
+
+struct ComputeWeightedAddChainConstants {
+    float4 weights[2];
+    uint4 offsets;
     uint2 length;
 };
 
 #ifdef VK_ZERO_CPU
 
 namespace compute_weighted_add {
-std::optional<int> create_buffer_storage(const VmaAllocator &allocator,
-                                         const VkDeviceSize &size,
-                                         VkBuffer &buffer,
-                                         VmaAllocation &allocation,
-                                         VmaAllocationInfo &allocation_info) {
-    VkBufferCreateInfo buffer_create_info = {
-        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
-    buffer_create_info.size = size;
-    buffer_create_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    VmaAllocationCreateInfo allocation_create_info = {};
-    allocation_create_info.usage = VMA_MEMORY_USAGE_UNKNOWN;
-    allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
-    allocation_create_info.requiredFlags =
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    if (vmaCreateBuffer(allocator, &buffer_create_info, &allocation_create_info,
-                        &buffer, &allocation, &allocation_info) != VK_SUCCESS) {
-        return -1;
+std::optional<int>
+create_buffer_storage(const VmaAllocator &allocator, const VkDeviceSize &size,
+                      const std::vector<uint32_t> &queue_indices,
+                      VkBuffer &buffer, VmaAllocation &allocation,
+                      VmaAllocationInfo &allocation_info,
+                      const bool &host = false) {
+    if (host) {
+        return create_buffer_host(allocator, size,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  queue_indices, buffer, allocation,
+                                  allocation_info);
     }
-    return {};
+    return create_buffer_device(allocator, size,
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                queue_indices, buffer, allocation,
+                                allocation_info);
 }
 
 std::optional<int>
@@ -72,11 +73,6 @@ create_set_pipeline_layout(const vkb::Device &device,
          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
          .descriptorCount = 1,
          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-         .pImmutableSamplers = nullptr},
-        {.binding = 4,
-         .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-         .descriptorCount = 1,
-         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
          .pImmutableSamplers = nullptr}};
     VkDescriptorSetLayoutCreateInfo set_create_info{
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
@@ -88,14 +84,19 @@ create_set_pipeline_layout(const vkb::Device &device,
                                     &set_layout) != VK_SUCCESS) {
         return -1;
     }
+    VkPushConstantRange push_constant_range{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = std::max(sizeof(ComputeWeightedAddConstants),
+                         sizeof(ComputeWeightedAddChainConstants))};
     VkPipelineLayoutCreateInfo pipeline_create_info{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .pNext = nullptr,
         .flags = 0,
         .setLayoutCount = 1,
         .pSetLayouts = &set_layout,
-        .pushConstantRangeCount = 0,
-        .pPushConstantRanges = nullptr};
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range};
     if (vkCreatePipelineLayout(device.device, &pipeline_create_info, nullptr,
                                &pipeline_layout) != VK_SUCCESS) {
         return -1;
@@ -113,33 +114,28 @@ allocate_descriptor_sets(const vkb::Device &device,
                          const VmaAllocationInfo &allocation_info_storage_c,
                          const VkBuffer &buffer_storage_d,
                          const VmaAllocationInfo &allocation_info_storage_d,
-                         const VkBuffer &buffer_uniform,
-                         const VmaAllocationInfo &allocation_info_uniform,
-                         const vkb::Swapchain &swapchain,
-                         const std::vector<VkImageView> &image_views,
+                         const uint32_t &count,
                          const VkDescriptorSetLayout &set_layout,
                          const VkDescriptorPool &descriptor_pool,
                          std::vector<VkDescriptorSet> &descriptor_sets) {
-    std::vector<VkDescriptorSetLayout> set_layouts{swapchain.image_count,
-                                                   set_layout};
+    std::vector<VkDescriptorSetLayout> set_layouts{count, set_layout};
     VkDescriptorSetAllocateInfo allocate_info{
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
         .pNext = nullptr,
         .descriptorPool = descriptor_pool,
-        .descriptorSetCount = swapchain.image_count,
+        .descriptorSetCount = count,
         .pSetLayouts = set_layouts.data()};
-    descriptor_sets = std::vector<VkDescriptorSet>{swapchain.image_count};
+    descriptor_sets = std::vector<VkDescriptorSet>{count};
     if (vkAllocateDescriptorSets(device.device, &allocate_info,
                                  descriptor_sets.data()) != VK_SUCCESS) {
         return -1;
     }
-    std::vector<VkDescriptorBufferInfo> buffer_info{swapchain.image_count * 5};
-    std::vector<VkWriteDescriptorSet> descriptor_writes{swapchain.image_count *
-                                                        5};
-    for (auto i = 0; i < swapchain.image_count; ++i) {
-        buffer_info[i * 5 + 0] = {
+    std::vector<VkDescriptorBufferInfo> buffer_info{count * 4};
+    std::vector<VkWriteDescriptorSet> descriptor_writes{count * 4};
+    for (auto i = 0; i < count; ++i) {
+        buffer_info[i * 4 + 0] = {
             .buffer = buffer_storage_a, .offset = 0, .range = VK_WHOLE_SIZE};
-        descriptor_writes[i * 5 + 0] = {
+        descriptor_writes[i * 4 + 0] = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .pNext = nullptr,
             .dstSet = descriptor_sets[i],
@@ -148,11 +144,11 @@ allocate_descriptor_sets(const vkb::Device &device,
             .descriptorCount = 1,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .pImageInfo = nullptr,
-            .pBufferInfo = &buffer_info[i * 5 + 0],
+            .pBufferInfo = &buffer_info[i * 4 + 0],
             .pTexelBufferView = nullptr};
-        buffer_info[i * 5 + 1] = {
+        buffer_info[i * 4 + 1] = {
             .buffer = buffer_storage_b, .offset = 0, .range = VK_WHOLE_SIZE};
-        descriptor_writes[i * 5 + 1] = {
+        descriptor_writes[i * 4 + 1] = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .pNext = nullptr,
             .dstSet = descriptor_sets[i],
@@ -161,11 +157,11 @@ allocate_descriptor_sets(const vkb::Device &device,
             .descriptorCount = 1,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .pImageInfo = nullptr,
-            .pBufferInfo = &buffer_info[i * 5 + 1],
+            .pBufferInfo = &buffer_info[i * 4 + 1],
             .pTexelBufferView = nullptr};
-        buffer_info[i * 5 + 2] = {
+        buffer_info[i * 4 + 2] = {
             .buffer = buffer_storage_c, .offset = 0, .range = VK_WHOLE_SIZE};
-        descriptor_writes[i * 5 + 2] = {
+        descriptor_writes[i * 4 + 2] = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .pNext = nullptr,
             .dstSet = descriptor_sets[i],
@@ -174,11 +170,11 @@ allocate_descriptor_sets(const vkb::Device &device,
             .descriptorCount = 1,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .pImageInfo = nullptr,
-            .pBufferInfo = &buffer_info[i * 5 + 2],
+            .pBufferInfo = &buffer_info[i * 4 + 2],
             .pTexelBufferView = nullptr};
-        buffer_info[i * 5 + 3] = {
+        buffer_info[i * 4 + 3] = {
             .buffer = buffer_storage_d, .offset = 0, .range = VK_WHOLE_SIZE};
-        descriptor_writes[i * 5 + 3] = {
+        descriptor_writes[i * 4 + 3] = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .pNext = nullptr,
             .dstSet = descriptor_sets[i],
@@ -187,26 +183,688 @@ allocate_descriptor_sets(const vkb::Device &device,
             .descriptorCount = 1,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .pImageInfo = nullptr,
-            .pBufferInfo = &buffer_info[i * 5 + 3],
+            .pBufferInfo = &buffer_info[i * 4 + 3],
             .pTexelBufferView = nullptr};
-        buffer_info[i * 5 + 4] = {
-            .buffer = buffer_uniform, .offset = 0, .range = VK_WHOLE_SIZE};
-        descriptor_writes[i * 5 + 4] = {
+    }
+    vkUpdateDescriptorSets(device.device, descriptor_writes.size(),
+                           descriptor_writes.data(), 0, nullptr);
+    return {};
+}
+
+std::optional<int> allocate_descriptor_set(
+    const vkb::Device &device,
+    const std::array<VkDescriptorBufferInfo, 4> &buffer_info,
+    const VkDescriptorSetLayout &set_layout,
+    const VkDescriptorPool &descriptor_pool, VkDescriptorSet &descriptor_set) {
+    VkDescriptorSetAllocateInfo allocate_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &set_layout};
+    if (vkAllocateDescriptorSets(device.device, &allocate_info,
+                                 &descriptor_set) != VK_SUCCESS) {
+        return -1;
+    }
+    std::array<VkWriteDescriptorSet, 4> descriptor_writes;
+    for (uint32_t i = 0; i < 4; ++i) {
+        descriptor_writes[i] = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .pNext = nullptr,
-            .dstSet = descriptor_sets[i],
-            .dstBinding = 4,
+            .dstSet = descriptor_set,
+            .dstBinding = i,
             .dstArrayElement = 0,
             .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .pImageInfo = nullptr,
-            .pBufferInfo = &buffer_info[i * 5 + 4],
+            .pBufferInfo = &buffer_info[i],
             .pTexelBufferView = nullptr};
     }
     vkUpdateDescriptorSets(device.device, descriptor_writes.size(),
                            descriptor_writes.data(), 0, nullptr);
     return {};
 }
+
+std::optional<int>
+get_streaming_chunk_length(const vkb::PhysicalDevice &physical_device,
+                           const VmaAllocator &allocator,
+                           const uint32_t &count, const uint3 &local_size,
+                           const uint64_t &length, uint64_t &chunk_length) {
+    auto &limits = physical_device.properties.limits;
+    const VkPhysicalDeviceMemoryProperties *memory_properties;
+    vmaGetMemoryProperties(allocator, &memory_properties);
+    std::vector<VmaBudget> budgets{memory_properties->memoryHeapCount};
+    vmaGetHeapBudgets(allocator, budgets.data());
+    VkDeviceSize available = 0;
+    for (auto i = 0; i < memory_properties->memoryHeapCount; ++i) {
+        if ((memory_properties->memoryHeaps[i].flags &
+             VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+            budgets[i].budget > budgets[i].usage) {
+            available =
+                std::max(available, budgets[i].budget - budgets[i].usage);
+        }
+    }
+    VkPhysicalDeviceMaintenance3Properties maintenance_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES};
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &maintenance_properties};
+    vkGetPhysicalDeviceProperties2(physical_device.physical_device,
+                                   &properties);
+    auto alignment = get_arena_alignment(physical_device);
+    chunk_length = std::min(
+        {static_cast<uint64_t>(limits.maxStorageBufferRange / (count * 4) /
+                               alignment * alignment) /
+             ELEMENT_SIZE,
+         static_cast<uint64_t>(limits.maxComputeWorkGroupCount[0] - 1) *
+             local_size.x * local_size.y,
+         available / 2 / (count * 4 * ELEMENT_SIZE),
+         maintenance_properties.maxMemoryAllocationSize /
+             (count * 4 * ELEMENT_SIZE)});
+    chunk_length -= chunk_length % ELEMENT_WIDTH;
+    if (chunk_length == 0) {
+        return -1;
+    }
+    chunk_length = std::min(chunk_length, length);
+    return {};
+}
+
+struct StreamingExecutor {
+    uint64_t chunk_length = 0;
+    Arena arena;
+    std::vector<std::array<VkDeviceSize, 4>> offsets_storage;
+    std::vector<VkDescriptorSet> descriptor_sets;
+    std::vector<VkCommandBuffer> command_buffers;
+    std::vector<VkFence> fences;
+    std::vector<VkSemaphore> semaphores;
+    StagingRing staging_ring;
+};
+
+std::optional<int> create_streaming_executor(
+    const vkb::PhysicalDevice &physical_device, const vkb::Device &device,
+    const VmaAllocator &allocator, const uint32_t &compute_queue_index,
+    const uint32_t &transfer_queue_index, const VkCommandPool &command_pool,
+    const VkDescriptorPool &descriptor_pool,
+    const VkDescriptorSetLayout &set_layout, const uint3 &local_size,
+    const uint32_t &count, const uint64_t &length,
+    StreamingExecutor &executor) {
+    if (auto error =
+            get_streaming_chunk_length(physical_device, allocator, count,
+                                       local_size, length,
+                                       executor.chunk_length)) {
+        return -1;
+    }
+    std::vector<uint32_t> queue_indices{compute_queue_index,
+                                        transfer_queue_index};
+    auto size = executor.chunk_length * ELEMENT_SIZE;
+    auto alignment = get_arena_alignment(physical_device);
+    if (auto error = create_arena(
+            physical_device, allocator,
+            count * 4 * ((size + alignment - 1) / alignment * alignment),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, queue_indices, false,
+            executor.arena)) {
+        return -1;
+    }
+    executor.offsets_storage =
+        std::vector<std::array<VkDeviceSize, 4>>{count};
+    executor.descriptor_sets = std::vector<VkDescriptorSet>{count};
+    for (auto i = 0; i < count; ++i) {
+        auto &offsets = executor.offsets_storage[i];
+        std::array<VkDescriptorBufferInfo, 4> buffer_info;
+        for (auto j = 0; j < 4; ++j) {
+            if (auto error = arena_allocate(executor.arena, size, offsets[j])) {
+                return -1;
+            }
+            buffer_info[j] = {.buffer = executor.arena.buffer,
+                              .offset = offsets[j],
+                              .range = size};
+        }
+        if (auto error = allocate_descriptor_set(
+                device, buffer_info, set_layout, descriptor_pool,
+                executor.descriptor_sets[i])) {
+            return -1;
+        }
+    }
+    if (auto error = allocate_command_buffers(device, command_pool, count,
+                                              executor.command_buffers)) {
+        return -1;
+    }
+    if (auto error = create_fences(device, count, executor.fences)) {
+        return -1;
+    }
+    if (auto error = create_semaphores(device, count, executor.semaphores)) {
+        return -1;
+    }
+    if (auto error = create_staging_ring(
+            device, allocator, transfer_queue_index, count * 2,
+            std::min<VkDeviceSize>(executor.chunk_length * ELEMENT_SIZE,
+                                   32 << 20),
+            executor.staging_ring)) {
+        return -1;
+    }
+    return {};
+}
+
+void destroy_streaming_executor(const vkb::Device &device,
+                                const VmaAllocator &allocator,
+                                const VkCommandPool &command_pool,
+                                const VkDescriptorPool &descriptor_pool,
+                                StreamingExecutor &executor) {
+    destroy_staging_ring(device, allocator, executor.staging_ring);
+    for (auto &semaphore : executor.semaphores) {
+        vkDestroySemaphore(device.device, semaphore, nullptr);
+    }
+    for (auto &fence : executor.fences) {
+        vkDestroyFence(device.device, fence, nullptr);
+    }
+    vkFreeCommandBuffers(device.device, command_pool,
+                         executor.command_buffers.size(),
+                         executor.command_buffers.data());
+    vkFreeDescriptorSets(device.device, descriptor_pool,
+                         executor.descriptor_sets.size(),
+                         executor.descriptor_sets.data());
+    destroy_arena(allocator, executor.arena);
+    executor = {};
+}
+
+std::optional<int>
+stream_weighted_add(const vkb::Device &device, const VkQueue &compute_queue,
+                    const VkQueue &transfer_queue, const VkPipeline &pipeline,
+                    const VkPipelineLayout &pipeline_layout,
+                    const uint3 &local_size, StreamingExecutor &executor,
+                    const float4 &weights, float4 *a, const float4 *b,
+                    const float4 *c, const float4 *d, const uint64_t &length,
+                    Profiler *profiler = nullptr,
+                    std::function<void(const uint64_t &, const uint64_t &)>
+                        complete = {},
+                    const std::array<HostImport, 3> *imports = nullptr) {
+    auto count = static_cast<uint32_t>(executor.fences.size());
+    auto &staging_ring = executor.staging_ring;
+    for (uint64_t first = 0, chunk = 0; first < length;
+         first += executor.chunk_length, ++chunk) {
+        auto slot = static_cast<uint32_t>(chunk % count);
+        auto chunk_length = std::min(executor.chunk_length, length - first);
+        auto size = chunk_length * ELEMENT_SIZE;
+        if (vkWaitForFences(device.device, 1, &executor.fences[slot], VK_TRUE,
+                            UINT64_MAX) != VK_SUCCESS) {
+            return -1;
+        }
+        if (vkResetFences(device.device, 1, &executor.fences[slot]) !=
+            VK_SUCCESS) {
+            return -1;
+        }
+        auto &buffer = executor.arena.buffer;
+        auto &offsets = executor.offsets_storage[slot];
+        const float4 *sources[] = {b, c, d};
+        for (auto j = 0; j < 3; ++j) {
+            if (imports && (*imports)[j].buffer != VK_NULL_HANDLE) {
+                auto &import = (*imports)[j];
+                if (auto error = staging_copy(
+                        device, staging_ring, import.buffer,
+                        import.offset + first * ELEMENT_SIZE, buffer,
+                        offsets[j + 1], size)) {
+                    return -1;
+                }
+            } else if (auto error = staging_upload(
+                           device, transfer_queue, staging_ring,
+                           sources[j] + first, size, buffer, offsets[j + 1])) {
+                return -1;
+            }
+        }
+        VkSemaphore upload_semaphore;
+        if (auto error = staging_submit(device, transfer_queue, staging_ring,
+                                        &upload_semaphore)) {
+            return -1;
+        }
+        auto &command_buffer = executor.command_buffers[slot];
+        if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
+            return -1;
+        }
+        VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            return -1;
+        }
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pipeline);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                pipeline_layout, 0, 1,
+                                &executor.descriptor_sets[slot], 0, nullptr);
+        ComputeWeightedAddConstants constants{
+            .weights = weights,
+            .length = uvec2(chunk_length / ELEMENT_WIDTH,
+                            chunk_length % ELEMENT_WIDTH)};
+        vkCmdPushConstants(command_buffer, pipeline_layout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                           &constants);
+        uint32_t region;
+        if (profiler) {
+            profiler_begin(*profiler, command_buffer,
+                           "compute_weighted_add_kernel", size * 4, region);
+        }
+        vkCmdDispatch(command_buffer,
+                      chunk_length / (local_size.x * local_size.y) + 1, 1, 1);
+        if (profiler) {
+            profiler_end(*profiler, command_buffer, region);
+        }
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            return -1;
+        }
+        VkPipelineStageFlags wait_stages[] = {
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
+        VkSubmitInfo submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &upload_semaphore,
+            .pWaitDstStageMask = wait_stages,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &executor.semaphores[slot]};
+        if (vkQueueSubmit(compute_queue, 1, &submit_info,
+                          executor.fences[slot]) != VK_SUCCESS) {
+            return -1;
+        }
+        if (profiler) {
+            profiler_submit(*profiler, executor.fences[slot]);
+        }
+        staging_wait_semaphore(staging_ring, executor.semaphores[slot],
+                               VK_PIPELINE_STAGE_TRANSFER_BIT);
+        if (auto error = staging_download(
+                device, transfer_queue, staging_ring, buffer, offsets[0],
+                size, a + first, [&complete, first, chunk_length]() {
+                    if (complete) {
+                        complete(first, chunk_length);
+                    }
+                })) {
+            return -1;
+        }
+        if (auto error = staging_submit(device, transfer_queue, staging_ring)) {
+            return -1;
+        }
+        if (auto error = staging_poll(device, staging_ring)) {
+            return -1;
+        }
+        if (profiler) {
+            if (auto error = profiler_resolve(device, *profiler)) {
+                return -1;
+            }
+        }
+    }
+    if (auto error = staging_finish(device, transfer_queue, staging_ring)) {
+        return -1;
+    }
+    if (vkWaitForFences(device.device, count, executor.fences.data(), VK_TRUE,
+                        UINT64_MAX) != VK_SUCCESS) {
+        return -1;
+    }
+    if (profiler) {
+        if (auto error = profiler_resolve(device, *profiler)) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+struct WeightedAddJob {
+    std::array<VkBuffer, 4> buffers;
+    uint4 offsets;
+    uint64_t length;
+    float4 weights;
+    std::array<VmaVirtualAllocation, 4> allocations;
+};
+
+std::optional<int> arena_allocate_job(Arena &arena, const uint64_t &length,
+                                      const float4 &weights,
+                                      WeightedAddJob &job) {
+    std::array<VkDeviceSize, 4> offsets;
+    std::array<VmaVirtualAllocation, 4> allocations;
+    for (auto i = 0; i < 4; ++i) {
+        if (auto error = arena_allocate(arena, length * ELEMENT_SIZE,
+                                        offsets[i], &allocations[i])) {
+            for (auto j = 0; j < i; ++j) {
+                arena_free(arena, allocations[j]);
+            }
+            return -1;
+        }
+        if (offsets[i] / ELEMENT_SIZE > UINT32_MAX) {
+            for (auto j = 0; j <= i; ++j) {
+                arena_free(arena, allocations[j]);
+            }
+            return -1;
+        }
+    }
+    job = {.buffers = {arena.buffer, arena.buffer, arena.buffer, arena.buffer},
+           .offsets = uvec4(offsets[0] / ELEMENT_SIZE,
+                            offsets[1] / ELEMENT_SIZE,
+                            offsets[2] / ELEMENT_SIZE,
+                            offsets[3] / ELEMENT_SIZE),
+           .length = length,
+           .weights = weights,
+           .allocations = allocations};
+    return {};
+}
+
+void arena_free_job(Arena &arena, const WeightedAddJob &job) {
+    for (auto &allocation : job.allocations) {
+        arena_free(arena, allocation);
+    }
+}
+
+struct JobQueue {
+    uint3 local_size;
+    uint32_t capacity;
+    uint32_t max_group_count;
+    uint32_t index = 0;
+    uint64_t submitted = 0;
+    std::vector<WeightedAddJob> pending;
+    std::vector<std::array<VkBuffer, 4>> descriptor_buffers;
+    std::vector<VkDescriptorSet> descriptor_sets;
+    std::vector<VkCommandBuffer> command_buffers;
+    std::vector<VkFence> fences;
+    std::vector<uint64_t> batches;
+    Recorder recorder;
+};
+
+std::optional<int> create_job_queue(const vkb::PhysicalDevice &physical_device,
+                                    const vkb::Device &device,
+                                    const uint32_t &queue_index,
+                                    const VkCommandPool &command_pool,
+                                    const uint3 &local_size,
+                                    const uint32_t &count,
+                                    const uint32_t &capacity,
+                                    JobQueue &job_queue) {
+    job_queue.local_size = local_size;
+    job_queue.capacity = capacity;
+    job_queue.max_group_count =
+        physical_device.properties.limits.maxComputeWorkGroupCount[0];
+    job_queue.batches = std::vector<uint64_t>(count, 0);
+    if (auto error = allocate_command_buffers(device, command_pool, count,
+                                              job_queue.command_buffers)) {
+        return -1;
+    }
+    if (auto error = create_fences(device, count, job_queue.fences)) {
+        return -1;
+    }
+    if (auto error = create_recorder(device, queue_index, count, capacity,
+                                     job_queue.recorder)) {
+        return -1;
+    }
+    return {};
+}
+
+void destroy_job_queue(const vkb::Device &device,
+                       const VkCommandPool &command_pool,
+                       const VkDescriptorPool &descriptor_pool,
+                       JobQueue &job_queue) {
+    destroy_recorder(device, job_queue.recorder);
+    for (auto &fence : job_queue.fences) {
+        vkDestroyFence(device.device, fence, nullptr);
+    }
+    vkFreeCommandBuffers(device.device, command_pool,
+                         job_queue.command_buffers.size(),
+                         job_queue.command_buffers.data());
+    if (!job_queue.descriptor_sets.empty()) {
+        vkFreeDescriptorSets(device.device, descriptor_pool,
+                             job_queue.descriptor_sets.size(),
+                             job_queue.descriptor_sets.data());
+    }
+    job_queue = {};
+}
+
+std::optional<int>
+get_job_descriptor_set(const vkb::Device &device,
+                       const VkDescriptorSetLayout &set_layout,
+                       const VkDescriptorPool &descriptor_pool,
+                       JobQueue &job_queue,
+                       const std::array<VkBuffer, 4> &buffers,
+                       VkDescriptorSet &descriptor_set) {
+    for (auto i = 0; i < job_queue.descriptor_buffers.size(); ++i) {
+        if (job_queue.descriptor_buffers[i] == buffers) {
+            descriptor_set = job_queue.descriptor_sets[i];
+            return {};
+        }
+    }
+    std::array<VkDescriptorBufferInfo, 4> buffer_info;
+    for (auto i = 0; i < 4; ++i) {
+        buffer_info[i] = {
+            .buffer = buffers[i], .offset = 0, .range = VK_WHOLE_SIZE};
+    }
+    if (auto error = allocate_descriptor_set(device, buffer_info, set_layout,
+                                             descriptor_pool, descriptor_set)) {
+        return -1;
+    }
+    job_queue.descriptor_buffers.push_back(buffers);
+    job_queue.descriptor_sets.push_back(descriptor_set);
+    return {};
+}
+
+// Frees the cached sets naming buffer; jobs reading or writing it must have
+// completed before the buffer is released.
+void release_job_descriptor_sets(const vkb::Device &device,
+                                 const VkDescriptorPool &descriptor_pool,
+                                 JobQueue &job_queue, const VkBuffer &buffer) {
+    auto &descriptor_buffers = job_queue.descriptor_buffers;
+    auto &descriptor_sets = job_queue.descriptor_sets;
+    for (auto i = descriptor_sets.size(); i-- > 0;) {
+        auto &buffers = descriptor_buffers[i];
+        if (std::find(buffers.begin(), buffers.end(), buffer) ==
+            buffers.end()) {
+            continue;
+        }
+        vkFreeDescriptorSets(device.device, descriptor_pool, 1,
+                             &descriptor_sets[i]);
+        descriptor_buffers.erase(descriptor_buffers.begin() + i);
+        descriptor_sets.erase(descriptor_sets.begin() + i);
+    }
+}
+
+std::optional<int> job_queue_flush(const vkb::Device &device,
+                                   const VkQueue &queue,
+                                   const VkPipeline &pipeline,
+                                   const VkPipelineLayout &pipeline_layout,
+                                   const VkDescriptorSetLayout &set_layout,
+                                   const VkDescriptorPool &descriptor_pool,
+                                   JobQueue &job_queue) {
+    if (job_queue.pending.empty()) {
+        return {};
+    }
+    auto &command_buffer = job_queue.command_buffers[job_queue.index];
+    auto &fence = job_queue.fences[job_queue.index];
+    if (vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX) !=
+        VK_SUCCESS) {
+        return -1;
+    }
+    if (vkResetFences(device.device, 1, &fence) != VK_SUCCESS) {
+        return -1;
+    }
+    if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
+        return -1;
+    }
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        return -1;
+    }
+    VkMemoryBarrier memory_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &memory_barrier, 0, nullptr, 0, nullptr);
+    using Range = std::tuple<VkBuffer, uint64_t, uint64_t>;
+    std::vector<Range> reads, writes;
+    auto overlaps = [](const std::vector<Range> &ranges, const Range &range) {
+        auto &[buffer, begin, end] = range;
+        return std::any_of(ranges.begin(), ranges.end(), [&](const Range &r) {
+            return std::get<0>(r) == buffer && std::get<1>(r) < end &&
+                   begin < std::get<2>(r);
+        });
+    };
+    auto &pending = job_queue.pending;
+    std::vector<bool> barriers(pending.size(), false);
+    std::vector<VkDescriptorSet> descriptor_sets(pending.size());
+    for (auto j = 0; j < pending.size(); ++j) {
+        auto &job = pending[j];
+        Range write{job.buffers[0], job.offsets.x, job.offsets.x + job.length};
+        std::array<Range, 3> job_reads{
+            Range{job.buffers[1], job.offsets.y, job.offsets.y + job.length},
+            Range{job.buffers[2], job.offsets.z, job.offsets.z + job.length},
+            Range{job.buffers[3], job.offsets.w, job.offsets.w + job.length}};
+        if (overlaps(writes, write) || overlaps(reads, write) ||
+            std::any_of(job_reads.begin(), job_reads.end(),
+                        [&](const Range &r) { return overlaps(writes, r); })) {
+            barriers[j] = true;
+            reads.clear();
+            writes.clear();
+        }
+        writes.push_back(write);
+        reads.insert(reads.end(), job_reads.begin(), job_reads.end());
+        if (auto error = get_job_descriptor_set(
+                device, set_layout, descriptor_pool, job_queue, job.buffers,
+                descriptor_sets[j])) {
+            return -1;
+        }
+    }
+    auto &recorder = job_queue.recorder;
+    auto segments = std::min<uint32_t>(recorder.worker_count, pending.size());
+    if (auto error = recorder_reset(device, recorder, job_queue.index)) {
+        return -1;
+    }
+    if (auto error = recorder_record(
+            device, recorder, job_queue.index, segments,
+            [&](const uint32_t &segment,
+                const VkCommandBuffer &command_buffer) -> std::optional<int> {
+                vkCmdBindPipeline(command_buffer,
+                                  VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+                VkDescriptorSet bound = VK_NULL_HANDLE;
+                for (auto j = pending.size() * segment / segments;
+                     j < pending.size() * (segment + 1) / segments; ++j) {
+                    auto &job = pending[j];
+                    if (barriers[j]) {
+                        vkCmdPipelineBarrier(
+                            command_buffer,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                            &memory_barrier, 0, nullptr, 0, nullptr);
+                    }
+                    if (descriptor_sets[j] != bound) {
+                        vkCmdBindDescriptorSets(
+                            command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipeline_layout, 0, 1, &descriptor_sets[j], 0,
+                            nullptr);
+                        bound = descriptor_sets[j];
+                    }
+                    ComputeWeightedAddConstants constants{
+                        .weights = job.weights,
+                        .offsets = job.offsets,
+                        .length = uvec2(job.length / ELEMENT_WIDTH,
+                                        job.length % ELEMENT_WIDTH)};
+                    vkCmdPushConstants(command_buffer, pipeline_layout,
+                                       VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                       sizeof(constants), &constants);
+                    vkCmdDispatch(command_buffer,
+                                  job.length / (job_queue.local_size.x *
+                                                job_queue.local_size.y) +
+                                      1,
+                                  1, 1);
+                }
+                return {};
+            })) {
+        return -1;
+    }
+    auto &secondary_command_buffers = recorder.recorded[job_queue.index];
+    vkCmdExecuteCommands(command_buffer, secondary_command_buffers.size(),
+                         secondary_command_buffers.data());
+    VkMemoryBarrier host_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT};
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_barrier, 0,
+                         nullptr, 0, nullptr);
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        return -1;
+    }
+    VkSubmitInfo submit_info = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                                .commandBufferCount = 1,
+                                .pCommandBuffers = &command_buffer};
+    if (vkQueueSubmit(queue, 1, &submit_info, fence) != VK_SUCCESS) {
+        return -1;
+    }
+    job_queue.batches[job_queue.index] = ++job_queue.submitted;
+    job_queue.index = (job_queue.index + 1) % job_queue.fences.size();
+    job_queue.pending.clear();
+    return {};
+}
+
+std::optional<int> job_queue_push(const vkb::Device &device,
+                                  const VkQueue &queue,
+                                  const VkPipeline &pipeline,
+                                  const VkPipelineLayout &pipeline_layout,
+                                  const VkDescriptorSetLayout &set_layout,
+                                  const VkDescriptorPool &descriptor_pool,
+                                  JobQueue &job_queue,
+                                  const WeightedAddJob &job,
+                                  uint64_t &ticket) {
+    auto &local_size = job_queue.local_size;
+    if (job.length / (local_size.x * local_size.y) + 1 >
+        job_queue.max_group_count) {
+        return -1;
+    }
+    if (job_queue.pending.size() == job_queue.capacity) {
+        if (auto error = job_queue_flush(device, queue, pipeline,
+                                         pipeline_layout, set_layout,
+                                         descriptor_pool, job_queue)) {
+            return -1;
+        }
+    }
+    job_queue.pending.push_back(job);
+    ticket = job_queue.submitted + 1;
+    return {};
+}
+
+std::optional<int> job_queue_status(const vkb::Device &device,
+                                    const JobQueue &job_queue,
+                                    const uint64_t &ticket, bool &complete) {
+    complete = true;
+    if (ticket > job_queue.submitted) {
+        complete = false;
+        return {};
+    }
+    for (auto i = 0; i < job_queue.fences.size(); ++i) {
+        if (job_queue.batches[i] == ticket) {
+            auto result = vkGetFenceStatus(device.device, job_queue.fences[i]);
+            if (result != VK_SUCCESS && result != VK_NOT_READY) {
+                return -1;
+            }
+            complete = result == VK_SUCCESS;
+        }
+    }
+    return {};
+}
+
+std::optional<int> job_queue_wait(const vkb::Device &device,
+                                  const JobQueue &job_queue,
+                                  const uint64_t &ticket) {
+    if (ticket > job_queue.submitted) {
+        return -1;
+    }
+    for (auto i = 0; i < job_queue.fences.size(); ++i) {
+        if (job_queue.batches[i] == ticket &&
+            vkWaitForFences(device.device, 1, &job_queue.fences[i], VK_TRUE,
+                            UINT64_MAX) != VK_SUCCESS) {
+            return -1;
+        }
+    }
+    return {};
+}
 } // namespace compute_weighted_add
 
 #else
@@ -3,32 +3,269 @@
 
 #include "compute_weighted_add.h"
 
-template <typename T>
-T weighted_add(float4 weights, const T &b, const T &c, const T &d) {
+#ifdef VK_ZERO_CPU
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define COMPUTE_WEIGHTED_ADD_X86
+#include <immintrin.h>
+#endif
+
+#else
+
+#endif
+
+template <typename B, typename C, typename D>
+auto weighted_add(float4 weights, const B &b, const C &c, const D &d) {
     return weights.x * (b * weights.y + c * weights.z + d * weights.w);
 }
 
-#ifndef VK_ZERO_CPU
-
 __kernel void
 compute_weighted_add_kernel(__global ComputeWeightedAddElement *a,
                             __global ComputeWeightedAddElement *b,
                             __global ComputeWeightedAddElement *c,
                             __global ComputeWeightedAddElement *d,
-                            __constant ComputeWeightedAddConstants *constants) {
-    uint64_t length = static_cast<uint64_t>(constants->length.x) *
+                            ComputeWeightedAddConstants constants) {
+    uint64_t length = static_cast<uint64_t>(constants.length.x) *
                           static_cast<uint64_t>(ELEMENT_WIDTH) +
-                      static_cast<uint64_t>(constants->length.y);
+                      static_cast<uint64_t>(constants.length.y);
     uint64_t i = static_cast<uint64_t>(get_global_id(0)) *
                      static_cast<uint64_t>(get_local_size(1)) +
                  static_cast<uint64_t>(get_local_id(1));
     if (i >= length)
         return;
-    uint64_t x = i / ELEMENT_WIDTH;
-    uint64_t y = i % ELEMENT_WIDTH;
-    a[x].element[y] = weighted_add(constants->weights, b[x].element[y],
-                                   c[x].element[y], d[x].element[y]);
+    uint64_t ia = i + constants.offsets.x;
+    uint64_t ib = i + constants.offsets.y;
+    uint64_t ic = i + constants.offsets.z;
+    uint64_t id = i + constants.offsets.w;
+    a[ia / ELEMENT_WIDTH].element[ia % ELEMENT_WIDTH] =
+        weighted_add(constants.weights,
+                     b[ib / ELEMENT_WIDTH].element[ib % ELEMENT_WIDTH],
+                     c[ic / ELEMENT_WIDTH].element[ic % ELEMENT_WIDTH],
+                     d[id / ELEMENT_WIDTH].element[id % ELEMENT_WIDTH]);
+}
+
+// Fuses a = weighted_add(second, weighted_add(first, b, c, d), c, d): the
+// second stage takes the first stage's result in place of b and reuses c and
+// d, so it matches two compute_weighted_add_kernel passes through a scratch.
+template <typename P>
+auto weighted_add_chain(float4 first, float4 second, P b, P c, P d,
+                        uint4 offsets) {
+    auto c_expression = expression_load<ELEMENT_WIDTH>(c, offsets.z);
+    auto d_expression = expression_load<ELEMENT_WIDTH>(d, offsets.w);
+    return weighted_add(
+        second,
+        weighted_add(first, expression_load<ELEMENT_WIDTH>(b, offsets.y),
+                     c_expression, d_expression),
+        c_expression, d_expression);
+}
+
+__kernel void
+compute_weighted_add_chain_kernel(__global ComputeWeightedAddElement *a,
+                                  __global ComputeWeightedAddElement *b,
+                                  __global ComputeWeightedAddElement *c,
+                                  __global ComputeWeightedAddElement *d,
+                                  ComputeWeightedAddChainConstants constants) {
+    uint64_t length = static_cast<uint64_t>(constants.length.x) *
+                          static_cast<uint64_t>(ELEMENT_WIDTH) +
+                      static_cast<uint64_t>(constants.length.y);
+    uint64_t i = static_cast<uint64_t>(get_global_id(0)) *
+                     static_cast<uint64_t>(get_local_size(1)) +
+                 static_cast<uint64_t>(get_local_id(1));
+    if (i >= length)
+        return;
+    uint64_t ia = i + constants.offsets.x;
+    a[ia / ELEMENT_WIDTH].element[ia % ELEMENT_WIDTH] =
+        weighted_add_chain(constants.weights[0], constants.weights[1], b, c,
+                           d, constants.offsets)[i];
+}
+
+#ifdef VK_ZERO_CPU
+
+namespace compute_weighted_add {
+constexpr uint64_t STREAM_THRESHOLD = 1 << 24;
+
+using WeightedAddFunction = void (*)(const float4 &weights, float *a,
+                                     const float *b, const float *c,
+                                     const float *d, uint64_t count);
+
+template <bool stream>
+void weighted_add_scalar(const float4 &weights, float *a, const float *b,
+                         const float *c, const float *d, uint64_t count) {
+    for (uint64_t i = 0; i < count; ++i) {
+        a[i] = weighted_add(weights, b[i], c[i], d[i]);
+    }
+}
+
+#ifdef COMPUTE_WEIGHTED_ADD_X86
+
+template <bool stream>
+__attribute__((target("sse2"))) void
+weighted_add_sse(const float4 &weights, float *a, const float *b,
+                 const float *c, const float *d, uint64_t count) {
+    uint64_t i = 0;
+    if (stream) {
+        for (; i < count && reinterpret_cast<uintptr_t>(a + i) % 16; ++i) {
+            a[i] = weighted_add(weights, b[i], c[i], d[i]);
+        }
+    }
+    auto x = _mm_set1_ps(weights.x), y = _mm_set1_ps(weights.y),
+         z = _mm_set1_ps(weights.z), w = _mm_set1_ps(weights.w);
+    for (; i + 4 <= count; i += 4) {
+        auto result = _mm_mul_ps(
+            x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b + i), y),
+                                     _mm_mul_ps(_mm_loadu_ps(c + i), z)),
+                          _mm_mul_ps(_mm_loadu_ps(d + i), w)));
+        if (stream) {
+            _mm_stream_ps(a + i, result);
+        } else {
+            _mm_storeu_ps(a + i, result);
+        }
+    }
+    if (stream) {
+        _mm_sfence();
+    }
+    weighted_add_scalar<false>(weights, a + i, b + i, c + i, d + i,
+                               count - i);
+}
+
+template <bool stream>
+__attribute__((target("avx2"))) void
+weighted_add_avx2(const float4 &weights, float *a, const float *b,
+                  const float *c, const float *d, uint64_t count) {
+    uint64_t i = 0;
+    if (stream) {
+        for (; i < count && reinterpret_cast<uintptr_t>(a + i) % 32; ++i) {
+            a[i] = weighted_add(weights, b[i], c[i], d[i]);
+        }
+    }
+    auto x = _mm256_set1_ps(weights.x), y = _mm256_set1_ps(weights.y),
+         z = _mm256_set1_ps(weights.z), w = _mm256_set1_ps(weights.w);
+    for (; i + 8 <= count; i += 8) {
+        auto b_y = _mm256_mul_ps(_mm256_loadu_ps(b + i), y);
+        auto c_z = _mm256_mul_ps(_mm256_loadu_ps(c + i), z);
+        auto d_w = _mm256_mul_ps(_mm256_loadu_ps(d + i), w);
+        auto result =
+            _mm256_mul_ps(x, _mm256_add_ps(_mm256_add_ps(b_y, c_z), d_w));
+        if (stream) {
+            _mm256_stream_ps(a + i, result);
+        } else {
+            _mm256_storeu_ps(a + i, result);
+        }
+    }
+    if (stream) {
+        _mm_sfence();
+    }
+    weighted_add_scalar<false>(weights, a + i, b + i, c + i, d + i,
+                               count - i);
+}
+
+template <bool stream>
+__attribute__((target("avx512f"))) void
+weighted_add_avx512(const float4 &weights, float *a, const float *b,
+                    const float *c, const float *d, uint64_t count) {
+    uint64_t i = 0;
+    if (stream) {
+        for (; i < count && reinterpret_cast<uintptr_t>(a + i) % 64; ++i) {
+            a[i] = weighted_add(weights, b[i], c[i], d[i]);
+        }
+    }
+    auto x = _mm512_set1_ps(weights.x), y = _mm512_set1_ps(weights.y),
+         z = _mm512_set1_ps(weights.z), w = _mm512_set1_ps(weights.w);
+    for (; i + 16 <= count; i += 16) {
+        auto b_y = _mm512_mul_ps(_mm512_loadu_ps(b + i), y);
+        auto c_z = _mm512_mul_ps(_mm512_loadu_ps(c + i), z);
+        auto d_w = _mm512_mul_ps(_mm512_loadu_ps(d + i), w);
+        auto result =
+            _mm512_mul_ps(x, _mm512_add_ps(_mm512_add_ps(b_y, c_z), d_w));
+        if (stream) {
+            _mm512_stream_ps(a + i, result);
+        } else {
+            _mm512_storeu_ps(a + i, result);
+        }
+    }
+    if (stream) {
+        _mm_sfence();
+    }
+    weighted_add_scalar<false>(weights, a + i, b + i, c + i, d + i,
+                               count - i);
+}
+
+#endif
+
+inline std::tuple<WeightedAddFunction, WeightedAddFunction>
+select_weighted_add() {
+#ifdef COMPUTE_WEIGHTED_ADD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {weighted_add_avx512<false>, weighted_add_avx512<true>};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return {weighted_add_avx2<false>, weighted_add_avx2<true>};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {weighted_add_sse<false>, weighted_add_sse<true>};
+    }
+#endif
+    return {weighted_add_scalar<false>, weighted_add_scalar<true>};
+}
+
+inline void weighted_add_host(const float4 &weights,
+                              ComputeWeightedAddElement *a,
+                              const ComputeWeightedAddElement *b,
+                              const ComputeWeightedAddElement *c,
+                              const ComputeWeightedAddElement *d,
+                              const uint64_t &length) {
+    static const auto functions = select_weighted_add();
+    auto function = length * ELEMENT_SIZE >= STREAM_THRESHOLD
+                        ? std::get<1>(functions)
+                        : std::get<0>(functions);
+    parallel_for(
+        (length + ELEMENT_WIDTH - 1) / ELEMENT_WIDTH, 1,
+        [&](uint64_t begin, uint64_t end) {
+            auto first = begin * ELEMENT_WIDTH;
+            auto count = std::min(end * ELEMENT_WIDTH, length) - first;
+            function(weights, reinterpret_cast<float *>(a) + first * 4,
+                     reinterpret_cast<const float *>(b) + first * 4,
+                     reinterpret_cast<const float *>(c) + first * 4,
+                     reinterpret_cast<const float *>(d) + first * 4,
+                     count * 4);
+        });
+}
+
+inline std::optional<int> compare_host(const ComputeWeightedAddElement *a,
+                                       const ComputeWeightedAddElement *b,
+                                       const uint64_t &length,
+                                       uint64_t &mismatch) {
+    for (mismatch = 0; mismatch < length; ++mismatch) {
+        auto &x = a[mismatch / ELEMENT_WIDTH].element[mismatch % ELEMENT_WIDTH];
+        auto &y = b[mismatch / ELEMENT_WIDTH].element[mismatch % ELEMENT_WIDTH];
+        if (any(greaterThan(abs(x - y), max(abs(y), vec4(1.f)) * 1e-5f))) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+inline void weighted_add_chain_host(const float4 &first, const float4 &second,
+                                    ComputeWeightedAddElement *a,
+                                    const ComputeWeightedAddElement *b,
+                                    const ComputeWeightedAddElement *c,
+                                    const ComputeWeightedAddElement *d,
+                                    const uint64_t &length) {
+    auto expression =
+        weighted_add_chain(first, second, b, c, d, uint4{0, 0, 0, 0});
+    parallel_for(
+        (length + ELEMENT_WIDTH - 1) / ELEMENT_WIDTH, 1,
+        [&](uint64_t begin, uint64_t end) {
+            auto last = std::min(end * ELEMENT_WIDTH, length);
+            for (auto i = begin * ELEMENT_WIDTH; i < last; ++i) {
+                a[i / ELEMENT_WIDTH].element[i % ELEMENT_WIDTH] =
+                    expression[i];
+            }
+        });
 }
+} // namespace compute_weighted_add
 
 #endif
 
@@ -1,5 +1,21 @@
 ﻿#include "main.h"
 
+#ifdef VK_ZERO_COUNT_ALLOCATIONS
+std::atomic<uint64_t> ALLOCATION_COUNT = 0;
+
+void *operator new(size_t size) {
+    ALLOCATION_COUNT.fetch_add(1, std::memory_order_relaxed);
+    if (auto pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+#endif
+
 int main(int argc, char *argv[]) {
     if (auto error = initialize()) {
         return -1;
@@ -41,15 +57,6 @@ int main(int argc, char *argv[]) {
         return -1;
     }
     MainConstants constants{.color = vec4(1.f, 1.f, 1.f, 1.f)};
-    VkBuffer buffer_uniform;
-    VmaAllocation allocation_uniform;
-    VmaAllocationInfo allocation_info_uniform;
-    if (auto error = create_buffer_uniform(allocator, sizeof(constants),
-                                           buffer_uniform, allocation_uniform,
-                                           allocation_info_uniform)) {
-        return -1;
-    }
-    memcpy(allocation_info_uniform.pMappedData, &constants, sizeof(constants));
     VkDescriptorSetLayout set_layout;
     VkPipelineLayout pipeline_layout;
     if (auto error =
@@ -63,44 +70,116 @@ int main(int argc, char *argv[]) {
         return -1;
     }
     auto entry_name = "device_kernel";
+    Tuning tuning;
+    int drawable_width, drawable_height;
+    SDL_Vulkan_GetDrawableSize(window, &drawable_width, &drawable_height);
+    auto tuning_bucket =
+        get_tuning_bucket(uint64_t(drawable_width) * drawable_height);
+    if (auto error = load_tuning(physical_device, tuning)) {
+        return -1;
+    }
+    find_tuning(tuning, entry_name, tuning_bucket, local_size);
+    auto cache_name = "main.cache";
+    VkPipelineCache pipeline_cache;
+    bool pipeline_cache_hit;
+    if (auto error =
+            create_pipeline_cache(physical_device, device, cache_name,
+                                  pipeline_cache, pipeline_cache_hit)) {
+        return -1;
+    }
+    auto pipeline_begin = std::chrono::steady_clock::now();
     VkPipeline pipeline;
-    if (auto error = create_pipeline(device, pipeline_layout, shader_module,
-                                     local_size, entry_name, pipeline)) {
+    if (auto error =
+            create_pipeline(device, pipeline_cache, pipeline_layout,
+                            shader_module, local_size, entry_name, pipeline)) {
         return -1;
     }
+    std::cout << "pipeline cache " << (pipeline_cache_hit ? "hit" : "miss")
+              << ": "
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - pipeline_begin)
+                     .count()
+              << " ms\n";
+    uint32_t frames_in_flight = 2;
+    if (auto frames = std::getenv("VK_ZERO_FRAMES_IN_FLIGHT")) {
+        frames_in_flight = std::max<uint32_t>(
+            static_cast<uint32_t>(std::strtoul(frames, nullptr, 10)), 1);
+    }
+    VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+    if (auto name = std::getenv("VK_ZERO_PRESENT_MODE")) {
+        if (auto error = get_present_mode(name, present_mode)) {
+            return -1;
+        }
+    }
     vkb::Swapchain swapchain;
     std::vector<VkImage> images;
     std::vector<VkImageView> image_views;
     std::vector<VkFence> signal_fences;
-    std::vector<VkSemaphore> wait_semaphores, signal_semaphores;
-    std::vector<VkFence> wait_fences;
+    std::vector<VkSemaphore> wait_semaphores, signal_semaphores,
+        present_semaphores;
     std::vector<VkFramebuffer> framebuffers;
     VkRenderPass render_pass;
     if (auto error =
             create_swapchain_semaphores_fences_render_pass_framebuffers(
-                device, swapchain, images, image_views, signal_fences,
-                wait_semaphores, signal_semaphores, render_pass,
-                framebuffers)) {
+                device, graphics_queue_index, compute_queue_index,
+                present_mode, frames_in_flight, swapchain, images,
+                image_views, signal_fences, wait_semaphores, signal_semaphores,
+                present_semaphores, render_pass, framebuffers)) {
+        return -1;
+    }
+    UniformRing uniform_ring;
+    if (auto error = create_uniform_ring(physical_device, allocator,
+                                         frames_in_flight, 4096,
+                                         uniform_ring)) {
         return -1;
     }
     std::vector<VkDescriptorSet> descriptor_sets;
     if (auto error = allocate_descriptor_sets(
-            device, buffer_uniform, allocation_info_uniform, swapchain,
-            image_views, set_layout, descriptor_pool, descriptor_sets)) {
+            device, swapchain, image_views, uniform_ring.buffer, set_layout,
+            descriptor_pool, descriptor_sets)) {
         return -1;
     }
     std::vector<VkCommandBuffer> graphics_command_buffers;
-    if (auto error = allocate_command_buffers(
-            window, device, graphics_queue_index, graphics_command_pool,
-            swapchain, graphics_command_buffers)) {
+    if (auto error = allocate_command_buffers(device, graphics_command_pool,
+                                              frames_in_flight,
+                                              graphics_command_buffers)) {
         return -1;
     }
     std::vector<VkCommandBuffer> compute_command_buffers;
-    if (auto error = allocate_command_buffers(
-            window, device, compute_queue_index, compute_command_pool,
-            swapchain, compute_command_buffers)) {
+    if (auto error = allocate_command_buffers(device, compute_command_pool,
+                                              frames_in_flight,
+                                              compute_command_buffers)) {
         return -1;
     }
+    Recorder recorder;
+    if (auto error = create_recorder(device, compute_queue_index,
+                                     frames_in_flight, 1, recorder)) {
+        return -1;
+    }
+    Profiler profiler;
+    auto profiling = !create_profiler(physical_device, device,
+                                      compute_queue_index, 256, profiler);
+    profiler.results.reserve(4096 + profiler.regions.size());
+    std::vector<uint3> tuning_candidates;
+    std::vector<VkPipeline> tuning_pipelines;
+    std::vector<std::vector<double>> tuning_durations;
+    std::vector<uint32_t> tuning_pending;
+    uint32_t tuning_frame = 0, tuning_samples = 16;
+    auto autotuning = profiling && std::getenv("VK_ZERO_AUTOTUNE");
+    if (autotuning) {
+        get_local_size_candidates(physical_device, 2, tuning_candidates);
+        for (auto &candidate : tuning_candidates) {
+            VkPipeline candidate_pipeline;
+            if (auto error = create_pipeline(
+                    device, pipeline_cache, pipeline_layout, shader_module,
+                    candidate, entry_name, candidate_pipeline)) {
+                return -1;
+            }
+            tuning_pipelines.push_back(candidate_pipeline);
+        }
+        tuning_durations.resize(tuning_candidates.size());
+        autotuning = !tuning_candidates.empty();
+    }
     ImGuiIO imgui_io;
     if (auto error = imgui_initialize(window, instance, physical_device, device,
                                       graphics_queue, graphics_queue_index,
@@ -108,49 +187,113 @@ int main(int argc, char *argv[]) {
                                       graphics_command_buffers[0], imgui_io)) {
         return -1;
     }
+    std::vector<VkRect2D> image_damage(swapchain.image_count);
+    std::vector<bool> image_fresh(swapchain.image_count, true);
+    std::vector<uint64_t> compute_keys(frames_in_flight, 0);
+    std::vector<bool> descriptor_stale(swapchain.image_count, false);
+    std::vector<std::vector<uint64_t>> descriptor_serials(
+        swapchain.image_count, std::vector<uint64_t>(frames_in_flight, 0));
+    FrameSerials frame_serials{
+        .submitted = std::vector<uint64_t>(frames_in_flight, 0),
+        .completed = std::vector<uint64_t>(frames_in_flight, 0)};
+    std::vector<RetiredSwapchain> retired;
+    bool resized = false, present_mode_changed = false;
+    std::vector<FrameStatistics> statistics(4);
+    for (auto &mode_statistics : statistics) {
+        create_frame_statistics(mode_statistics);
+    }
+    std::vector<double> statistics_scratch;
+    statistics_scratch.reserve(4097);
+    char statistics_text[1024] = "";
+    auto statistics_time = std::chrono::steady_clock::now();
+    auto present_time = std::chrono::steady_clock::now();
+    bool input_pending = false;
+    uint32_t input_ticks = 0;
+    uint64_t frame = 0;
+    uint64_t draw_data_hash = 0;
+    VkRect2D draw_data_bounds = {};
+    auto previous_constants = constants;
+    uint32_t slot = 0;
+    uint64_t resolved = 0;
+    uint32_t steady_frames = 0;
+    uint64_t steady_allocations = 0;
     uint32_t index = 0;
     uint32_t quit = 0;
     SDL_Event event;
     bool show_demo_window = true;
     auto reset = [&]() -> std::optional<int> {
         vkDeviceWaitIdle(device.device);
-        vkFreeCommandBuffers(device.device, compute_command_pool,
-                             compute_command_buffers.size(),
-                             compute_command_buffers.data());
-        vkFreeCommandBuffers(device.device, graphics_command_pool,
-                             graphics_command_buffers.size(),
-                             graphics_command_buffers.data());
+        frame_serials.completed = frame_serials.submitted;
+        if (auto error = collect_retired(device, frame_serials, retired,
+                                         true)) {
+            return -1;
+        }
+        if (profiling) {
+            if (auto error = profiler_resolve(device, profiler, true)) {
+                return -1;
+            }
+        }
         vkFreeDescriptorSets(device.device, descriptor_pool,
                              descriptor_sets.size(), descriptor_sets.data());
         if (auto error =
                 create_swapchain_semaphores_fences_render_pass_framebuffers(
-                    device, swapchain, images, image_views, signal_fences,
-                    wait_semaphores, signal_semaphores, render_pass,
+                    device, graphics_queue_index, compute_queue_index,
+                    present_mode, frames_in_flight, swapchain, images,
+                    image_views, signal_fences, wait_semaphores,
+                    signal_semaphores, present_semaphores, render_pass,
                     framebuffers, true)) {
             return -1;
         }
         if (auto error = allocate_descriptor_sets(
-                device, buffer_uniform, allocation_info_uniform, swapchain,
-                image_views, set_layout, descriptor_pool, descriptor_sets)) {
+                device, swapchain, image_views, uniform_ring.buffer,
+                set_layout, descriptor_pool, descriptor_sets)) {
             return -1;
         }
-        if (auto error = allocate_command_buffers(
-                window, device, graphics_queue_index, graphics_command_pool,
-                swapchain, graphics_command_buffers)) {
-            return -1;
-        }
-        if (auto error = allocate_command_buffers(
-                window, device, compute_queue_index, compute_command_pool,
-                swapchain, compute_command_buffers)) {
+        ImGui_ImplVulkan_SetMinImageCount(swapchain.image_count);
+        image_damage = std::vector<VkRect2D>(swapchain.image_count);
+        image_fresh = std::vector<bool>(swapchain.image_count, true);
+        compute_keys = std::vector<uint64_t>(frames_in_flight, 0);
+        descriptor_stale = std::vector<bool>(swapchain.image_count, false);
+        descriptor_serials = std::vector<std::vector<uint64_t>>(
+            swapchain.image_count, std::vector<uint64_t>(frames_in_flight, 0));
+        draw_data_hash = 0;
+        slot = 0;
+        index = 0;
+        steady_frames = 0;
+        return {};
+    };
+    auto resize = [&]() -> std::optional<int> {
+        auto result = resize_swapchain(
+            device, graphics_queue_index, compute_queue_index, present_mode,
+            swapchain, images, image_views, frame_serials, render_pass,
+            framebuffers, retired);
+        if (result == 1) {
+            return reset();
+        } else if (result) {
             return -1;
         }
-        ImGui_ImplVulkan_SetMinImageCount(swapchain.image_count);
+        image_damage = std::vector<VkRect2D>(swapchain.image_count);
+        image_fresh = std::vector<bool>(swapchain.image_count, true);
+        compute_keys = std::vector<uint64_t>(frames_in_flight, 0);
+        descriptor_stale = std::vector<bool>(swapchain.image_count, true);
+        draw_data_hash = 0;
         index = 0;
+        steady_frames = 0;
         return {};
     };
     while (!quit) {
         while (SDL_PollEvent(&event)) {
             ImGui_ImplSDL2_ProcessEvent(&event);
+            if (!input_pending &&
+                (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP ||
+                 event.type == SDL_TEXTINPUT ||
+                 event.type == SDL_MOUSEMOTION ||
+                 event.type == SDL_MOUSEBUTTONDOWN ||
+                 event.type == SDL_MOUSEBUTTONUP ||
+                 event.type == SDL_MOUSEWHEEL)) {
+                input_pending = true;
+                input_ticks = event.common.timestamp;
+            }
             switch (event.type) {
             case SDL_KEYUP:
                 if (event.key.keysym.sym == SDLK_ESCAPE)
@@ -165,9 +308,7 @@ int main(int argc, char *argv[]) {
                     event.window.windowID == SDL_GetWindowID(window))
                     quit = 1;
                 if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-                    if (auto error = reset()) {
-                        return -1;
-                    }
+                    resized = true;
                 }
                 break;
 
@@ -175,125 +316,382 @@ int main(int argc, char *argv[]) {
                 break;
             }
         }
-        int width, height;
-        SDL_Vulkan_GetDrawableSize(window, &width, &height);
+        if (resized || present_mode_changed) {
+            int width, height;
+            SDL_Vulkan_GetDrawableSize(window, &width, &height);
+            if (present_mode_changed ||
+                uint32_t(width) != swapchain.extent.width ||
+                uint32_t(height) != swapchain.extent.height) {
+                if (auto error = resize()) {
+                    return -1;
+                }
+            }
+            resized = false;
+            present_mode_changed = false;
+        }
+        if (auto error = collect_retired(device, frame_serials, retired)) {
+            return -1;
+        }
         ImGui_ImplVulkan_NewFrame();
         ImGui_ImplSDL2_NewFrame(window);
         ImGui::NewFrame();
         if (show_demo_window)
             ImGui::ShowDemoWindow(&show_demo_window);
+        if (std::chrono::steady_clock::now() - statistics_time >
+            std::chrono::seconds(1)) {
+            size_t length = 0;
+            statistics_text[0] = '\0';
+            for (uint32_t mode = 0; mode < statistics.size(); ++mode) {
+                if (!statistics[mode].frame_times.empty() &&
+                    length < sizeof(statistics_text)) {
+                    auto written = get_frame_statistics_text(
+                        VkPresentModeKHR(mode), statistics[mode],
+                        statistics_scratch, statistics_text + length,
+                        sizeof(statistics_text) - length);
+                    length += std::max(written, 0);
+                }
+            }
+            statistics_time = std::chrono::steady_clock::now();
+        }
+        ImGui::Begin("Frame pacing");
+        ImGui::Text("%u frames in flight, %u images", frames_in_flight,
+                    swapchain.image_count);
+        ImGui::ColorEdit4("Color", &constants.color.x);
+        for (auto mode :
+             {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+              VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR}) {
+            if (ImGui::RadioButton(get_present_mode_name(mode),
+                                   swapchain.present_mode == mode) &&
+                swapchain.present_mode != mode) {
+                present_mode = mode;
+                present_mode_changed = true;
+            }
+        }
+        ImGui::TextUnformatted(statistics_text);
+        ImGui::End();
         ImGui::Render();
         ImDrawData *draw_data = ImGui::GetDrawData();
-        if (auto error = frame_submit(
-                device, graphics_queue, compute_queue, swapchain, signal_fences,
-                wait_semaphores, signal_semaphores, graphics_command_buffers,
-                compute_command_buffers, index,
-                [&](const uint32_t &index,
-                    const VkCommandBuffer &command_buffer)
-                    -> std::optional<int> {
-                    VkViewport viewport = {
-                        .x = 0.0f,
-                        .y = 0.0f,
-                        .width = (float)swapchain.extent.width,
-                        .height = (float)swapchain.extent.height,
-                        .minDepth = 0.0f,
-                        .maxDepth = 1.0f};
-                    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-                    VkRect2D scissor = {.offset = {0, 0},
-                                        .extent = swapchain.extent};
-                    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-                    VkClearValue clear_values{{{0.0f, 0.0f, 0.0f, 0.0f}}};
-                    VkRenderPassBeginInfo begin_info = {
-                        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-                        .renderPass = render_pass,
-                        .framebuffer = framebuffers[index],
-                        .renderArea = {.offset = {0, 0},
-                                       .extent = swapchain.extent},
-                        .clearValueCount = 1,
-                        .pClearValues = &clear_values};
-                    vkCmdBeginRenderPass(command_buffer, &begin_info,
-                                         VK_SUBPASS_CONTENTS_INLINE);
-                    ImGui_ImplVulkan_RenderDrawData(draw_data, command_buffer);
-                    vkCmdEndRenderPass(command_buffer);
-                    vkCmdBindPipeline(command_buffer,
-                                      VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-                    vkCmdBindDescriptorSets(
-                        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                        pipeline_layout, 0, 1, &descriptor_sets[index], 0,
-                        nullptr);
+        uint64_t hash;
+        VkRect2D bounds;
+        get_draw_data_damage(draw_data, swapchain.extent, hash, bounds);
+        VkRect2D frame_damage = {};
+        if (hash != draw_data_hash) {
+            damage_union(frame_damage, bounds);
+            damage_union(frame_damage, draw_data_bounds);
+        }
+        if (autotuning || draw_data_hash == 0 ||
+            memcmp(&constants, &previous_constants, sizeof(constants))) {
+            frame_damage = {.offset = {0, 0}, .extent = swapchain.extent};
+        }
+        draw_data_hash = hash;
+        draw_data_bounds = bounds;
+        previous_constants = constants;
+        if (!frame_damage.extent.width || !frame_damage.extent.height) {
+            input_pending = false;
+            SDL_WaitEventTimeout(nullptr, 16);
+            continue;
+        }
+        damage_align(frame_damage, local_size, swapchain.extent);
+        for (auto &damage : image_damage) {
+            damage_union(damage, frame_damage);
+        }
+        auto profiled = profiling && (autotuning || frame++ % 64 == 0);
+        uint32_t constants_offset = 0;
+        auto frame_slot = slot;
+        auto frame_serial = frame_serials.serial;
+        auto compute_fence = signal_fences[slot * 2 + 1];
+        auto result = frame_submit(
+            device, graphics_queue, compute_queue, swapchain, signal_fences,
+            frame_serials, wait_semaphores, signal_semaphores,
+            present_semaphores, graphics_command_buffers,
+            compute_command_buffers, compute_keys, recorder, 1, slot, index,
+            [&](const uint32_t &index,
+                const VkCommandBuffer &command_buffer)
+                -> std::optional<int> {
+                uniform_ring_begin(uniform_ring, slot);
+                if (auto error = uniform_ring_allocate(
+                        uniform_ring, &constants, sizeof(constants),
+                        constants_offset)) {
+                    return -1;
+                }
+                if (descriptor_stale[index]) {
+                    auto &serials = descriptor_serials[index];
+                    for (uint32_t i = 0; i < frames_in_flight; ++i) {
+                        if (frame_serials.completed[i] < serials[i]) {
+                            if (vkWaitForFences(device.device, 2,
+                                                &signal_fences[i * 2], VK_TRUE,
+                                                UINT64_MAX) != VK_SUCCESS) {
+                                return -1;
+                            }
+                            frame_serials.completed[i] =
+                                frame_serials.submitted[i];
+                        }
+                        if (serials[i]) {
+                            compute_keys[i] = 0;
+                        }
+                    }
+                    update_descriptor_set(device, image_views[index],
+                                          descriptor_sets[index]);
+                    descriptor_stale[index] = false;
+                }
+                if (image_fresh[index]) {
                     VkImageMemoryBarrier image_memory_barrier{
                         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
                         .pNext = nullptr,
                         .srcAccessMask = 0,
-                        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
-                                         VK_ACCESS_SHADER_WRITE_BIT,
-                        .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-                        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
-                        .srcQueueFamilyIndex = graphics_queue_index,
-                        .dstQueueFamilyIndex = compute_queue_index,
-                        .image = images[index],
-                        .subresourceRange = {.aspectMask =
-                                                 VK_IMAGE_ASPECT_COLOR_BIT,
-                                             .baseMipLevel = 0,
-                                             .levelCount = 1,
-                                             .baseArrayLayer = 0,
-                                             .layerCount = 1}};
-                    vkCmdPipelineBarrier(
-                        command_buffer,
-                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0,
-                        nullptr, 1, &image_memory_barrier);
-                    return {};
-                },
-                [&](const uint32_t &index,
-                    const VkCommandBuffer &command_buffer)
-                    -> std::optional<int> {
-                    vkCmdBindPipeline(command_buffer,
-                                      VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-                    vkCmdBindDescriptorSets(
-                        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                        pipeline_layout, 0, 1, &descriptor_sets[index], 0,
-                        nullptr);
-                    vkCmdDispatch(command_buffer, width / local_size.x + 1,
-                                  height / local_size.y + 1, 1);
-                    VkImageMemoryBarrier image_memory_barrier{
-                        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-                        .pNext = nullptr,
-                        .srcAccessMask = VK_ACCESS_SHADER_READ_BIT |
-                                         VK_ACCESS_SHADER_WRITE_BIT,
                         .dstAccessMask = 0,
-                        .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+                        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
                         .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                        .srcQueueFamilyIndex = compute_queue_index,
-                        .dstQueueFamilyIndex = graphics_queue_index,
+                        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
                         .image = images[index],
-                        .subresourceRange = {.aspectMask =
-                                                 VK_IMAGE_ASPECT_COLOR_BIT,
-                                             .baseMipLevel = 0,
-                                             .levelCount = 1,
-                                             .baseArrayLayer = 0,
-                                             .layerCount = 1}};
+                        .subresourceRange = {
+                            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                            .baseMipLevel = 0,
+                            .levelCount = 1,
+                            .baseArrayLayer = 0,
+                            .layerCount = 1}};
                     vkCmdPipelineBarrier(
-                        command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
-                        nullptr, 1, &image_memory_barrier);
-                    return {};
-                })) {
-            if (error == 0) {
-                if (auto error = reset()) {
+                        command_buffer,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                        0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+                    image_fresh[index] = false;
+                }
+                VkViewport viewport = {
+                    .x = 0.0f,
+                    .y = 0.0f,
+                    .width = (float)swapchain.extent.width,
+                    .height = (float)swapchain.extent.height,
+                    .minDepth = 0.0f,
+                    .maxDepth = 1.0f};
+                vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+                vkCmdSetScissor(command_buffer, 0, 1,
+                                &image_damage[index]);
+                VkClearValue clear_values{{{0.0f, 0.0f, 0.0f, 0.0f}}};
+                VkRenderPassBeginInfo begin_info = {
+                    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                    .renderPass = render_pass,
+                    .framebuffer = framebuffers[index],
+                    .renderArea = image_damage[index],
+                    .clearValueCount = 1,
+                    .pClearValues = &clear_values};
+                vkCmdBeginRenderPass(command_buffer, &begin_info,
+                                     VK_SUBPASS_CONTENTS_INLINE);
+                clip_draw_data(draw_data, image_damage[index]);
+                ImGui_ImplVulkan_RenderDrawData(draw_data, command_buffer);
+                vkCmdEndRenderPass(command_buffer);
+                return {};
+            },
+            [&](const uint32_t &index, const uint32_t &i,
+                const VkCommandBuffer &command_buffer)
+                -> std::optional<int> {
+                auto candidate =
+                    autotuning
+                        ? tuning_frame++ % tuning_candidates.size()
+                        : 0;
+                auto &frame_pipeline =
+                    autotuning ? tuning_pipelines[candidate] : pipeline;
+                auto &frame_local_size =
+                    autotuning ? tuning_candidates[candidate] : local_size;
+                vkCmdBindPipeline(command_buffer,
+                                  VK_PIPELINE_BIND_POINT_COMPUTE,
+                                  frame_pipeline);
+                vkCmdBindDescriptorSets(
+                    command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    pipeline_layout, 0, 1, &descriptor_sets[index], 1,
+                    &constants_offset);
+                auto &damage = image_damage[index];
+                auto x0 = damage.offset.x / frame_local_size.x *
+                          frame_local_size.x;
+                auto y0 = damage.offset.y / frame_local_size.y *
+                          frame_local_size.y;
+                auto x1 = damage.offset.x + damage.extent.width;
+                auto y1 = damage.offset.y + damage.extent.height;
+                uint2 offset = uvec2(x0, y0);
+                vkCmdPushConstants(command_buffer, pipeline_layout,
+                                   VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                   sizeof(offset), &offset);
+                uint32_t region = UINT32_MAX;
+                if (profiled) {
+                    profiler_begin(profiler, command_buffer,
+                                   "device_kernel",
+                                   uint64_t(damage.extent.width) *
+                                       damage.extent.height * 8,
+                                   region);
+                }
+                vkCmdDispatch(
+                    command_buffer,
+                    (x1 - x0 + frame_local_size.x - 1) / frame_local_size.x,
+                    (y1 - y0 + frame_local_size.y - 1) / frame_local_size.y,
+                    1);
+                if (profiled) {
+                    profiler_end(profiler, command_buffer, region);
+                }
+                if (autotuning && region != UINT32_MAX) {
+                    tuning_pending.push_back(candidate);
+                }
+                VkImageMemoryBarrier image_memory_barrier{
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                    .pNext = nullptr,
+                    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                    .dstAccessMask = 0,
+                    .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+                    .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .image = images[index],
+                    .subresourceRange = {.aspectMask =
+                                             VK_IMAGE_ASPECT_COLOR_BIT,
+                                         .baseMipLevel = 0,
+                                         .levelCount = 1,
+                                         .baseArrayLayer = 0,
+                                         .layerCount = 1}};
+                vkCmdPipelineBarrier(
+                    command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                    nullptr, 1, &image_memory_barrier);
+                return {};
+            },
+            [&](const uint32_t &index) -> uint64_t {
+                if (profiled) {
+                    return 0;
+                }
+                uint64_t key = 14695981039346656037ull;
+                hash_combine(key, &pipeline, sizeof(pipeline));
+                hash_combine(key, &descriptor_sets[index],
+                             sizeof(descriptor_sets[index]));
+                hash_combine(key, &swapchain.extent,
+                             sizeof(swapchain.extent));
+                hash_combine(key, &image_damage[index],
+                             sizeof(image_damage[index]));
+                hash_combine(key, &constants_offset,
+                             sizeof(constants_offset));
+                return key;
+            });
+        if (profiling) {
+            profiler_submit(profiler, compute_fence);
+        }
+        if (frame_serials.serial != frame_serial) {
+            descriptor_serials[index][frame_slot] = frame_serials.serial;
+        }
+        if (result) {
+            if (result == 0) {
+                if (auto error = resize()) {
                     return -1;
                 }
+            } else if (result != 1) {
+                return -1;
             }
-            if (error == 1) {
-            } else {
+        } else {
+            image_damage[index] = {};
+            auto &mode_statistics = statistics[swapchain.present_mode];
+            auto now = std::chrono::steady_clock::now();
+            frame_statistics_push(
+                mode_statistics.frame_times,
+                std::chrono::duration<double, std::milli>(now - present_time)
+                    .count());
+            present_time = now;
+            if (input_pending) {
+                frame_statistics_push(mode_statistics.latencies,
+                                      double(SDL_GetTicks() - input_ticks));
+                input_pending = false;
+            }
+        }
+        if (profiling) {
+            if (auto error = profiler_resolve(device, profiler)) {
                 return -1;
             }
+            for (auto i = resolved; i < profiler.results.size(); ++i) {
+                frame_statistics_push(
+                    statistics[swapchain.present_mode].gpu_times,
+                    profiler.results[i].duration / 1e3);
+            }
+            for (auto i = resolved; autotuning && i < profiler.results.size();
+                 ++i) {
+                tuning_durations[tuning_pending.front()].push_back(
+                    profiler.results[i].duration);
+                tuning_pending.erase(tuning_pending.begin());
+            }
+            if (autotuning &&
+                std::all_of(tuning_durations.begin(), tuning_durations.end(),
+                            [&](const std::vector<double> &durations) {
+                                return durations.size() >= tuning_samples;
+                            })) {
+                auto duration = std::numeric_limits<double>::infinity();
+                uint32_t best = 0;
+                for (auto i = 0; i < tuning_durations.size(); ++i) {
+                    auto &durations = tuning_durations[i];
+                    std::sort(durations.begin(), durations.end());
+                    if (durations[durations.size() / 2] < duration) {
+                        duration = durations[durations.size() / 2];
+                        best = i;
+                    }
+                }
+                local_size = tuning_candidates[best];
+                update_tuning(tuning, entry_name, tuning_bucket, local_size,
+                              duration);
+                if (auto error = save_tuning(tuning)) {
+                    return -1;
+                }
+                vkDeviceWaitIdle(device.device);
+                vkDestroyPipeline(device.device, pipeline, nullptr);
+                pipeline = tuning_pipelines[best];
+                for (auto i = 0; i < tuning_pipelines.size(); ++i) {
+                    if (i != best) {
+                        vkDestroyPipeline(device.device, tuning_pipelines[i],
+                                          nullptr);
+                    }
+                }
+                tuning_pipelines.clear();
+                autotuning = false;
+            }
+            if (profiler.results.size() > 4096) {
+                profiler.results.erase(profiler.results.begin(),
+                                       profiler.results.end() - 4096);
+            }
+            resolved = profiler.results.size();
         }
+#ifdef VK_ZERO_COUNT_ALLOCATIONS
+        if (autotuning) {
+            steady_frames = 0;
+        } else if (steady_frames < 256) {
+            if (++steady_frames == 256) {
+                steady_allocations = ALLOCATION_COUNT;
+            }
+        } else if (ALLOCATION_COUNT != steady_allocations) {
+            std::cout << "steady-state allocations: "
+                      << ALLOCATION_COUNT - steady_allocations << "\n";
+            return -1;
+        }
+#endif
     }
     vkDeviceWaitIdle(device.device);
+    if (auto error = collect_retired(device, frame_serials, retired, true)) {
+        return -1;
+    }
+    for (uint32_t mode = 0; mode < statistics.size(); ++mode) {
+        if (!statistics[mode].frame_times.empty()) {
+            get_frame_statistics_text(VkPresentModeKHR(mode),
+                                      statistics[mode], statistics_scratch,
+                                      statistics_text,
+                                      sizeof(statistics_text));
+            std::cout << statistics_text;
+        }
+    }
+    if (profiling) {
+        if (auto error = profiler_resolve(device, profiler, true)) {
+            return -1;
+        }
+        auto trace_name = "main.trace.json";
+        profiler_export(profiler, trace_name);
+        destroy_profiler(device, profiler);
+    }
     ImGui_ImplVulkan_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
+    destroy_recorder(device, recorder);
+    destroy_uniform_ring(allocator, uniform_ring);
     vkFreeCommandBuffers(device.device, compute_command_pool,
                          compute_command_buffers.size(),
                          compute_command_buffers.data());
@@ -312,16 +710,22 @@ int main(int argc, char *argv[]) {
     for (auto &semaphore : wait_semaphores) {
         vkDestroySemaphore(device.device, semaphore, nullptr);
     }
+    for (auto &semaphore : present_semaphores) {
+        vkDestroySemaphore(device.device, semaphore, nullptr);
+    }
     for (auto &fence : signal_fences) {
         vkDestroyFence(device.device, fence, nullptr);
     }
     swapchain.destroy_image_views(image_views);
     vkb::destroy_swapchain(swapchain);
+    for (auto &tuning_pipeline : tuning_pipelines) {
+        vkDestroyPipeline(device.device, tuning_pipeline, nullptr);
+    }
     vkDestroyPipeline(device.device, pipeline, nullptr);
+    destroy_pipeline_cache(device, cache_name, pipeline_cache);
     vkDestroyShaderModule(device.device, shader_module, nullptr);
     vkDestroyPipelineLayout(device.device, pipeline_layout, nullptr);
     vkDestroyDescriptorSetLayout(device.device, set_layout, nullptr);
-    vmaDestroyBuffer(allocator, buffer_uniform, allocation_uniform);
     vkDestroyDescriptorPool(device.device, descriptor_pool, nullptr);
     vkDestroyCommandPool(device.device, compute_command_pool, nullptr);
     vkDestroyCommandPool(device.device, graphics_command_pool, nullptr);
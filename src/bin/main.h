@@ -5,6 +5,8 @@
 
 #ifdef VK_ZERO_CPU
 
+#include "kernels.h"
+
 #else
 
 #endif
@@ -14,10 +16,13 @@ struct MainConstants {
 
 #ifdef VK_ZERO_CPU
 
-std::optional<int> initialize() {
+std::optional<int> initialize(bool headless = false) {
     if (auto result = volkInitialize(); result != VK_SUCCESS) {
         return -1;
     }
+    if (headless) {
+        return {};
+    }
     if (auto result = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS |
                                SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER);
         result < 0) {
@@ -67,28 +72,62 @@ std::optional<int> create_window_instance_surface(const char *&name,
     return {};
 }
 
+std::optional<int> create_instance_headless(const char *&name,
+                                            vkb::Instance &instance) {
+    vkb::InstanceBuilder instance_builder{};
+    instance_builder.set_headless();
+#if !(NDEBUG)
+    instance_builder.request_validation_layers();
+    instance_builder.use_default_debug_messenger();
+#endif
+    if (auto result = instance_builder.set_app_name(name)
+                          .require_api_version(1, 1)
+                          .build();
+        !result) {
+        return -1;
+    } else {
+        instance = result.value();
+    }
+    volkLoadInstance(instance.instance);
+    return {};
+}
+
 std::optional<int> create_device_allocator(const vkb::Instance &instance,
                                            const VkSurfaceKHR &surface,
                                            vkb::PhysicalDevice &physical_device,
                                            vkb::Device &device,
                                            VmaAllocator &allocator) {
-    if (auto result = vkb::PhysicalDeviceSelector{instance}
-                          .set_minimum_version(1, 1)
-                          .set_required_features(
-                              {.shaderStorageImageWriteWithoutFormat = VK_TRUE,
-                               .shaderInt64 = VK_TRUE})
-                          .set_required_features_11(
-                              {.variablePointersStorageBuffer = VK_TRUE,
-                               .variablePointers = VK_TRUE})
-                          .add_desired_extension("VK_KHR_portability_subset")
-                          .set_surface(surface)
-                          .select();
-        !result) {
+    vkb::PhysicalDeviceSelector selector{instance};
+    selector.set_minimum_version(1, 1)
+        .set_required_features({.shaderStorageImageWriteWithoutFormat = VK_TRUE,
+                                .shaderInt64 = VK_TRUE})
+        .set_required_features_11({.variablePointersStorageBuffer = VK_TRUE,
+                                   .variablePointers = VK_TRUE})
+        .add_desired_extension("VK_KHR_portability_subset")
+        .add_desired_extension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    if (surface != VK_NULL_HANDLE) {
+        selector.set_surface(surface);
+    }
+    if (auto result = selector.select(); !result) {
         return -1;
     } else {
         physical_device = result.value();
     }
-    if (auto result = vkb::DeviceBuilder{physical_device}.build(); !result) {
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physical_device.physical_device, &features);
+    physical_device.features.pipelineStatisticsQuery =
+        features.pipelineStatisticsQuery;
+    std::vector<vkb::CustomQueueDescription> queue_descriptions;
+    auto queue_families = physical_device.get_queue_families();
+    for (uint32_t i = 0; i < queue_families.size(); ++i) {
+        auto count = std::min(queue_families[i].queueCount, 2u);
+        queue_descriptions.push_back(vkb::CustomQueueDescription(
+            i, count, std::vector<float>(count, 1.f)));
+    }
+    if (auto result = vkb::DeviceBuilder{physical_device}
+                          .custom_queue_setup(queue_descriptions)
+                          .build();
+        !result) {
         return -1;
     } else {
         device = result.value();
@@ -117,16 +156,62 @@ std::optional<int> get_graphics_compute_queue(const vkb::Device &device,
         graphics_queue_index = result.value();
     }
     vkGetDeviceQueue(device.device, graphics_queue_index, 0, &graphics_queue);
-    if (auto result = device.get_queue_index(vkb::QueueType::present);
-        !result.has_value()) {
-        return -1;
+    uint32_t compute_queue_offset = 0;
+    if (auto result =
+            device.get_dedicated_queue_index(vkb::QueueType::compute);
+        result.has_value()) {
+        compute_queue_index = result.value();
+    } else if (auto result = device.get_queue_index(vkb::QueueType::compute);
+               result.has_value() && result.value() != graphics_queue_index) {
+        compute_queue_index = result.value();
     } else {
+        compute_queue_index = graphics_queue_index;
+        if (device.queue_families[graphics_queue_index].queueCount > 1) {
+            compute_queue_offset = 1;
+        }
+    }
+    vkGetDeviceQueue(device.device, compute_queue_index, compute_queue_offset,
+                     &compute_queue);
+    return {};
+}
+
+std::optional<int> get_compute_queue(const vkb::Device &device,
+                                     VkQueue &compute_queue,
+                                     uint32_t &compute_queue_index) {
+    if (auto result = device.get_queue_index(vkb::QueueType::compute);
+        result.has_value()) {
+        compute_queue_index = result.value();
+    } else if (auto result = device.get_queue_index(vkb::QueueType::graphics);
+               result.has_value()) {
         compute_queue_index = result.value();
+    } else {
+        return -1;
     }
     vkGetDeviceQueue(device.device, compute_queue_index, 0, &compute_queue);
     return {};
 }
 
+std::optional<int> get_transfer_queue(const vkb::Device &device,
+                                      const VkQueue &compute_queue,
+                                      const uint32_t &compute_queue_index,
+                                      VkQueue &transfer_queue,
+                                      uint32_t &transfer_queue_index) {
+    if (auto result =
+            device.get_dedicated_queue_index(vkb::QueueType::transfer);
+        result.has_value()) {
+        transfer_queue_index = result.value();
+    } else if (auto result = device.get_queue_index(vkb::QueueType::transfer);
+               result.has_value() && result.value() != compute_queue_index) {
+        transfer_queue_index = result.value();
+    } else {
+        transfer_queue = compute_queue;
+        transfer_queue_index = compute_queue_index;
+        return {};
+    }
+    vkGetDeviceQueue(device.device, transfer_queue_index, 0, &transfer_queue);
+    return {};
+}
+
 std::optional<int> create_command_pool(const vkb::Device &device,
                                        const uint32_t &queue_index,
                                        VkCommandPool &command_pool) {
@@ -204,7 +289,7 @@ create_set_pipeline_layout(const vkb::Device &device,
          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
          .pImmutableSamplers = nullptr},
         {.binding = 1,
-         .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+         .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
          .descriptorCount = 1,
          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
          .pImmutableSamplers = nullptr}};
@@ -218,14 +303,18 @@ create_set_pipeline_layout(const vkb::Device &device,
                                     &set_layout) != VK_SUCCESS) {
         return -1;
     }
+    VkPushConstantRange push_constant_range{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(uint2)};
     VkPipelineLayoutCreateInfo pipeline_create_info{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .pNext = nullptr,
         .flags = 0,
         .setLayoutCount = 1,
         .pSetLayouts = &set_layout,
-        .pushConstantRangeCount = 0,
-        .pPushConstantRanges = nullptr};
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range};
     if (vkCreatePipelineLayout(device.device, &pipeline_create_info, nullptr,
                                &pipeline_layout) != VK_SUCCESS) {
         return -1;
@@ -236,18 +325,18 @@ create_set_pipeline_layout(const vkb::Device &device,
 std::optional<int> create_shader_module(const vkb::Device &device,
                                         const char *&name,
                                         VkShaderModule &shader_module) {
-    std::ifstream file(name, std::ios::ate | std::ios::binary);
-    if (!file.is_open()) {
+    auto kernel = std::find_if(
+        std::begin(EMBEDDED_KERNELS), std::end(EMBEDDED_KERNELS),
+        [&](const EmbeddedKernel &kernel) {
+            return strcmp(kernel.name, name) == 0;
+        });
+    if (kernel == std::end(EMBEDDED_KERNELS)) {
         return -1;
     }
-    size_t file_size = (size_t)file.tellg();
-    std::vector<char> code(file_size);
-    file.seekg(0);
-    file.read(code.data(), static_cast<std::streamsize>(file_size));
     VkShaderModuleCreateInfo create_info = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = code.size(),
-        .pCode = reinterpret_cast<const uint32_t *>(code.data())};
+        .codeSize = kernel->size,
+        .pCode = kernel->code};
     if (vkCreateShaderModule(device.device, &create_info, nullptr,
                              &shader_module) != VK_SUCCESS) {
         return -1;
@@ -255,7 +344,82 @@ std::optional<int> create_shader_module(const vkb::Device &device,
     return {};
 }
 
+std::optional<int>
+create_pipeline_cache(const vkb::PhysicalDevice &physical_device,
+                      const vkb::Device &device, const char *&path,
+                      VkPipelineCache &pipeline_cache, bool &hit) {
+    std::vector<char> data;
+    if (std::ifstream file(path, std::ios::ate | std::ios::binary);
+        file.is_open()) {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file) {
+            data.clear();
+        }
+    }
+    hit = false;
+    if (data.size() >= sizeof(VkPipelineCacheHeaderVersionOne)) {
+        VkPipelineCacheHeaderVersionOne header;
+        memcpy(&header, data.data(), sizeof(header));
+        auto &properties = physical_device.properties;
+        hit = header.headerSize >= sizeof(header) &&
+              header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+              header.vendorID == properties.vendorID &&
+              header.deviceID == properties.deviceID &&
+              memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+                     VK_UUID_SIZE) == 0;
+    }
+    VkPipelineCacheCreateInfo create_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .initialDataSize = hit ? data.size() : 0,
+        .pInitialData = hit ? data.data() : nullptr};
+    if (vkCreatePipelineCache(device.device, &create_info, nullptr,
+                              &pipeline_cache) != VK_SUCCESS) {
+        return -1;
+    }
+    return {};
+}
+
+std::optional<int> destroy_pipeline_cache(const vkb::Device &device,
+                                          const char *&path,
+                                          VkPipelineCache &pipeline_cache) {
+    size_t size = 0;
+    std::vector<char> data;
+    auto result =
+        vkGetPipelineCacheData(device.device, pipeline_cache, &size, nullptr);
+    if (result == VK_SUCCESS) {
+        data.resize(size);
+        result = vkGetPipelineCacheData(device.device, pipeline_cache, &size,
+                                        data.data());
+    }
+    vkDestroyPipelineCache(device.device, pipeline_cache, nullptr);
+    pipeline_cache = VK_NULL_HANDLE;
+    if (result != VK_SUCCESS) {
+        return -1;
+    }
+    auto temporary_path = std::filesystem::path{path};
+    temporary_path += ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(size));
+        if (!file) {
+            return -1;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    if (error) {
+        std::filesystem::remove(temporary_path, error);
+        return -1;
+    }
+    return {};
+}
+
 std::optional<int> create_pipeline(const vkb::Device &device,
+                                   const VkPipelineCache &pipeline_cache,
                                    const VkPipelineLayout &pipeline_layout,
                                    const VkShaderModule &shader_module,
                                    const uint3 &local_size, const char *&name,
@@ -285,22 +449,155 @@ std::optional<int> create_pipeline(const vkb::Device &device,
         .layout = pipeline_layout,
         .basePipelineHandle = nullptr,
         .basePipelineIndex = 0};
-    if (vkCreateComputePipelines(device.device, nullptr, 1, &create_info,
-                                 nullptr, &pipeline) != VK_SUCCESS) {
+    if (vkCreateComputePipelines(device.device, pipeline_cache, 1,
+                                 &create_info, nullptr,
+                                 &pipeline) != VK_SUCCESS) {
         return -1;
     }
     return {};
 }
 
-std::optional<int> create_swapchain_semaphores_fences_render_pass_framebuffers(
-    const vkb::Device &device, vkb::Swapchain &swapchain,
-    std::vector<VkImage> &images, std::vector<VkImageView> &image_views,
-    std::vector<VkFence> &signal_fences,
-    std::vector<VkSemaphore> &wait_semaphores,
-    std::vector<VkSemaphore> &signal_semaphores, VkRenderPass &render_pass,
-    std::vector<VkFramebuffer> &framebuffers, bool destroy = false) {
+struct TuningEntry {
+    std::string kernel;
+    uint32_t bucket;
+    uint3 local_size;
+    double duration;
+};
+
+struct Tuning {
+    std::string path;
+    std::vector<TuningEntry> entries;
+};
+
+uint32_t get_tuning_bucket(const uint64_t &size) {
+    uint32_t bucket = 0;
+    for (auto remaining = size; remaining >= 4; remaining /= 4) {
+        ++bucket;
+    }
+    return bucket;
+}
+
+std::optional<int> load_tuning(const vkb::PhysicalDevice &physical_device,
+                               Tuning &tuning) {
+    VkPhysicalDeviceIDProperties id_properties{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES};
+    VkPhysicalDeviceProperties2 properties{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &id_properties};
+    vkGetPhysicalDeviceProperties2(physical_device.physical_device,
+                                   &properties);
+    char key[VK_UUID_SIZE * 2 + 1];
+    for (auto i = 0; i < VK_UUID_SIZE; ++i) {
+        snprintf(key + i * 2, 3, "%02x", id_properties.deviceUUID[i]);
+    }
+    tuning.path = std::string{key} + "-" +
+                  std::to_string(properties.properties.driverVersion) +
+                  ".tuning";
+    tuning.entries.clear();
+    std::ifstream file(tuning.path);
+    TuningEntry entry;
+    while (file >> entry.kernel >> entry.bucket >> entry.local_size.x >>
+           entry.local_size.y >> entry.local_size.z >> entry.duration) {
+        tuning.entries.push_back(entry);
+    }
+    return {};
+}
+
+std::optional<int> save_tuning(const Tuning &tuning) {
+    auto temporary_path = std::filesystem::path{tuning.path};
+    temporary_path += ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::trunc);
+        for (auto &entry : tuning.entries) {
+            file << entry.kernel << " " << entry.bucket << " "
+                 << entry.local_size.x << " " << entry.local_size.y << " "
+                 << entry.local_size.z << " " << entry.duration << "\n";
+        }
+        if (!file) {
+            return -1;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary_path, tuning.path, error);
+    if (error) {
+        std::filesystem::remove(temporary_path, error);
+        return -1;
+    }
+    return {};
+}
+
+std::optional<int> find_tuning(const Tuning &tuning, const std::string &kernel,
+                               const uint32_t &bucket, uint3 &local_size) {
+    for (auto &entry : tuning.entries) {
+        if (entry.kernel == kernel && entry.bucket == bucket) {
+            local_size = entry.local_size;
+            return {};
+        }
+    }
+    return -1;
+}
+
+void update_tuning(Tuning &tuning, const std::string &kernel,
+                   const uint32_t &bucket, const uint3 &local_size,
+                   const double &duration) {
+    for (auto &entry : tuning.entries) {
+        if (entry.kernel == kernel && entry.bucket == bucket) {
+            entry.local_size = local_size;
+            entry.duration = duration;
+            return;
+        }
+    }
+    tuning.entries.push_back({kernel, bucket, local_size, duration});
+}
+
+void get_local_size_candidates(const vkb::PhysicalDevice &physical_device,
+                               const uint32_t &dimensions,
+                               std::vector<uint3> &candidates) {
+    auto &limits = physical_device.properties.limits;
+    candidates.clear();
+    for (uint32_t x = 1; x <= limits.maxComputeWorkGroupSize[0]; x *= 2) {
+        for (uint32_t y = 1; y <= limits.maxComputeWorkGroupSize[1]; y *= 2) {
+            if (dimensions < 2 && y > 1) {
+                break;
+            }
+            if (x * y >= 32 && x * y <= limits.maxComputeWorkGroupInvocations) {
+                candidates.push_back(uvec3(x, y, 1));
+            }
+        }
+    }
+}
+
+std::optional<int> autotune_local_size(
+    const std::vector<uint3> &candidates,
+    std::function<std::optional<int>(const uint3 &, double &)> measure,
+    uint3 &local_size, double &duration) {
+    duration = std::numeric_limits<double>::infinity();
+    for (auto &candidate : candidates) {
+        double candidate_duration;
+        if (auto error = measure(candidate, candidate_duration)) {
+            return -1;
+        }
+        if (candidate_duration < duration) {
+            duration = candidate_duration;
+            local_size = candidate;
+        }
+    }
+    if (candidates.empty()) {
+        return -1;
+    }
+    return {};
+}
+
+std::optional<int> build_swapchain(const vkb::Device &device,
+                                   const uint32_t &graphics_queue_index,
+                                   const uint32_t &compute_queue_index,
+                                   const VkPresentModeKHR &present_mode,
+                                   const vkb::Swapchain *old_swapchain,
+                                   vkb::Swapchain &swapchain) {
     auto builder =
-        vkb::SwapchainBuilder{device}
+        vkb::SwapchainBuilder{device.physical_device.physical_device,
+                              device.device, device.surface,
+                              graphics_queue_index, compute_queue_index}
             .add_fallback_format(
                 {VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR})
             .add_fallback_format(
@@ -308,23 +605,84 @@ std::optional<int> create_swapchain_semaphores_fences_render_pass_framebuffers(
             .add_format_feature_flags(VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)
             .add_format_feature_flags(VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)
             .add_image_usage_flags(VK_IMAGE_USAGE_STORAGE_BIT)
-            .add_image_usage_flags(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
-    if (destroy) {
-        builder.set_old_swapchain(swapchain);
+            .add_image_usage_flags(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
+            .set_desired_present_mode(present_mode)
+            .add_fallback_present_mode(VK_PRESENT_MODE_FIFO_KHR);
+    if (old_swapchain) {
+        builder.set_old_swapchain(*old_swapchain);
     }
-    if (auto result = builder.build(); !result) {
+    auto result = builder.build();
+    if (!result) {
         return -1;
-    } else {
-        if (destroy) {
-            for (auto &framebuffer : framebuffers) {
-                vkDestroyFramebuffer(device.device, framebuffer, nullptr);
-            }
-            vkDestroyRenderPass(device.device, render_pass, nullptr);
+    }
+    swapchain = result.value();
+    return {};
+}
+
+std::optional<int>
+create_framebuffers(const vkb::Device &device, const vkb::Swapchain &swapchain,
+                    const std::vector<VkImageView> &image_views,
+                    const VkRenderPass &render_pass,
+                    std::vector<VkFramebuffer> &framebuffers) {
+    framebuffers = std::vector<VkFramebuffer>{swapchain.image_count};
+    for (auto i = 0; i < swapchain.image_count; i++) {
+        VkFramebufferCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+            .renderPass = render_pass,
+            .attachmentCount = 1,
+            .pAttachments = &image_views[i],
+            .width = swapchain.extent.width,
+            .height = swapchain.extent.height,
+            .layers = 1};
+        if (vkCreateFramebuffer(device.device, &create_info, nullptr,
+                                &framebuffers[i]) != VK_SUCCESS) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+std::optional<int> create_present_semaphores(
+    const vkb::Device &device, const vkb::Swapchain &swapchain,
+    std::vector<VkSemaphore> &present_semaphores) {
+    present_semaphores = std::vector<VkSemaphore>{swapchain.image_count};
+    VkSemaphoreCreateInfo semaphore_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    for (auto &semaphore : present_semaphores) {
+        if (vkCreateSemaphore(device.device, &semaphore_info, nullptr,
+                              &semaphore) != VK_SUCCESS) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+std::optional<int> create_swapchain_semaphores_fences_render_pass_framebuffers(
+    const vkb::Device &device, const uint32_t &graphics_queue_index,
+    const uint32_t &compute_queue_index, const VkPresentModeKHR &present_mode,
+    const uint32_t &frames_in_flight, vkb::Swapchain &swapchain,
+    std::vector<VkImage> &images, std::vector<VkImageView> &image_views,
+    std::vector<VkFence> &signal_fences,
+    std::vector<VkSemaphore> &wait_semaphores,
+    std::vector<VkSemaphore> &signal_semaphores,
+    std::vector<VkSemaphore> &present_semaphores, VkRenderPass &render_pass,
+    std::vector<VkFramebuffer> &framebuffers, bool destroy = false) {
+    vkb::Swapchain next_swapchain;
+    if (auto error =
+            build_swapchain(device, graphics_queue_index, compute_queue_index,
+                            present_mode, destroy ? &swapchain : nullptr,
+                            next_swapchain)) {
+        return -1;
+    }
+    if (destroy) {
+        for (auto &framebuffer : framebuffers) {
+            vkDestroyFramebuffer(device.device, framebuffer, nullptr);
         }
-        swapchain.destroy_image_views(image_views);
-        vkb::destroy_swapchain(swapchain);
-        swapchain = result.value();
+        vkDestroyRenderPass(device.device, render_pass, nullptr);
     }
+    swapchain.destroy_image_views(image_views);
+    vkb::destroy_swapchain(swapchain);
+    swapchain = next_swapchain;
     images = swapchain.get_images().value();
     image_views = swapchain.get_image_views().value();
     if (destroy) {
@@ -337,29 +695,36 @@ std::optional<int> create_swapchain_semaphores_fences_render_pass_framebuffers(
         for (auto &semaphore : signal_semaphores) {
             vkDestroySemaphore(device.device, semaphore, nullptr);
         }
+        for (auto &semaphore : present_semaphores) {
+            vkDestroySemaphore(device.device, semaphore, nullptr);
+        }
     }
-    signal_fences = std::vector<VkFence>{swapchain.image_count * 2};
-    wait_semaphores = std::vector<VkSemaphore>{swapchain.image_count};
-    signal_semaphores = std::vector<VkSemaphore>{swapchain.image_count * 2};
+    signal_fences = std::vector<VkFence>{frames_in_flight * 2};
+    wait_semaphores = std::vector<VkSemaphore>{frames_in_flight};
+    signal_semaphores = std::vector<VkSemaphore>{frames_in_flight};
     VkFenceCreateInfo fence_info = {.sType =
                                         VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
                                     .flags = VK_FENCE_CREATE_SIGNALED_BIT};
     VkSemaphoreCreateInfo semaphore_info = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
-    for (auto i = 0; i < swapchain.image_count; i++) {
+    for (auto i = 0; i < frames_in_flight; i++) {
         if (vkCreateSemaphore(device.device, &semaphore_info, nullptr,
-                              &wait_semaphores[i]) != VK_SUCCESS) {
+                              &wait_semaphores[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(device.device, &semaphore_info, nullptr,
+                              &signal_semaphores[i]) != VK_SUCCESS) {
             return -1;
         }
     }
-    for (auto i = 0; i < swapchain.image_count * 2; i++) {
-        if (vkCreateFence(device.device, &fence_info, nullptr,
-                          &signal_fences[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device.device, &semaphore_info, nullptr,
-                              &signal_semaphores[i]) != VK_SUCCESS) {
+    for (auto &fence : signal_fences) {
+        if (vkCreateFence(device.device, &fence_info, nullptr, &fence) !=
+            VK_SUCCESS) {
             return -1;
         }
     }
+    if (auto error =
+            create_present_semaphores(device, swapchain, present_semaphores)) {
+        return -1;
+    }
     VkAttachmentDescription attachment = {
         .format = swapchain.image_format,
         .samples = VK_SAMPLE_COUNT_1_BIT,
@@ -367,7 +732,7 @@ std::optional<int> create_swapchain_semaphores_fences_render_pass_framebuffers(
         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
         .finalLayout = VK_IMAGE_LAYOUT_GENERAL};
     VkAttachmentReference color_attachment = {
         .attachment = 0, .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
@@ -378,7 +743,7 @@ std::optional<int> create_swapchain_semaphores_fences_render_pass_framebuffers(
     VkSubpassDependency dependency = {
         .srcSubpass = VK_SUBPASS_EXTERNAL,
         .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
         .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
         .srcAccessMask = 0,
         .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
@@ -395,18 +760,108 @@ std::optional<int> create_swapchain_semaphores_fences_render_pass_framebuffers(
                            &render_pass) != VK_SUCCESS) {
         return -1;
     }
-    framebuffers = std::vector<VkFramebuffer>{swapchain.image_count};
-    for (auto i = 0; i < swapchain.image_count; i++) {
-        VkFramebufferCreateInfo create_info = {
-            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-            .renderPass = render_pass,
-            .attachmentCount = 1,
-            .pAttachments = &image_views[i],
-            .width = swapchain.extent.width,
-            .height = swapchain.extent.height,
-            .layers = 1};
-        if (vkCreateFramebuffer(device.device, &create_info, nullptr,
-                                &framebuffers[i]) != VK_SUCCESS) {
+    return create_framebuffers(device, swapchain, image_views, render_pass,
+                               framebuffers);
+}
+
+// Per frame slot, the serial of the last submission and of the last one
+// known complete, updated when frame_submit waits for the slot's fences.
+struct FrameSerials {
+    uint64_t serial = 0;
+    std::vector<uint64_t> submitted, completed;
+};
+
+struct RetiredSwapchain {
+    vkb::Swapchain swapchain;
+    std::vector<VkImageView> image_views;
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<uint64_t> serials;
+};
+
+std::optional<int>
+resize_swapchain(const vkb::Device &device,
+                 const uint32_t &graphics_queue_index,
+                 const uint32_t &compute_queue_index,
+                 const VkPresentModeKHR &present_mode,
+                 vkb::Swapchain &swapchain, std::vector<VkImage> &images,
+                 std::vector<VkImageView> &image_views,
+                 const FrameSerials &serials, const VkRenderPass &render_pass,
+                 std::vector<VkFramebuffer> &framebuffers,
+                 std::vector<RetiredSwapchain> &retired) {
+    vkb::Swapchain next_swapchain;
+    if (auto error =
+            build_swapchain(device, graphics_queue_index, compute_queue_index,
+                            present_mode, &swapchain, next_swapchain)) {
+        return -1;
+    }
+    retired.push_back({.swapchain = swapchain,
+                       .image_views = image_views,
+                       .framebuffers = framebuffers,
+                       .serials = serials.submitted});
+    auto compatible = next_swapchain.image_count == swapchain.image_count &&
+                      next_swapchain.image_format == swapchain.image_format;
+    swapchain = next_swapchain;
+    images = swapchain.get_images().value();
+    image_views = swapchain.get_image_views().value();
+    framebuffers.clear();
+    if (!compatible) {
+        return 1;
+    }
+    if (auto error = create_framebuffers(device, swapchain, image_views,
+                                         render_pass, framebuffers)) {
+        return -1;
+    }
+    return {};
+}
+
+std::optional<int> collect_retired(const vkb::Device &device,
+                                   const FrameSerials &serials,
+                                   std::vector<RetiredSwapchain> &retired,
+                                   const bool &idle = false) {
+    for (auto it = retired.begin(); it != retired.end();) {
+        auto pending = false;
+        for (auto i = 0; i < it->serials.size() && !idle; ++i) {
+            pending = pending || serials.completed[i] < it->serials[i];
+        }
+        if (pending) {
+            ++it;
+            continue;
+        }
+        for (auto &framebuffer : it->framebuffers) {
+            vkDestroyFramebuffer(device.device, framebuffer, nullptr);
+        }
+        it->swapchain.destroy_image_views(it->image_views);
+        vkb::destroy_swapchain(it->swapchain);
+        it = retired.erase(it);
+    }
+    return {};
+}
+
+std::optional<int> create_fences(const vkb::Device &device,
+                                 const uint32_t &count,
+                                 std::vector<VkFence> &fences) {
+    fences = std::vector<VkFence>{count};
+    VkFenceCreateInfo fence_info = {.sType =
+                                        VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                                    .flags = VK_FENCE_CREATE_SIGNALED_BIT};
+    for (auto &fence : fences) {
+        if (vkCreateFence(device.device, &fence_info, nullptr, &fence) !=
+            VK_SUCCESS) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+std::optional<int> create_semaphores(const vkb::Device &device,
+                                     const uint32_t &count,
+                                     std::vector<VkSemaphore> &semaphores) {
+    semaphores = std::vector<VkSemaphore>{count};
+    VkSemaphoreCreateInfo semaphore_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    for (auto &semaphore : semaphores) {
+        if (vkCreateSemaphore(device.device, &semaphore_info, nullptr,
+                              &semaphore) != VK_SUCCESS) {
             return -1;
         }
     }
@@ -415,10 +870,9 @@ std::optional<int> create_swapchain_semaphores_fences_render_pass_framebuffers(
 
 std::optional<int>
 allocate_descriptor_sets(const vkb::Device &device,
-                         const VkBuffer &buffer_uniform,
-                         const VmaAllocationInfo &allocation_info_uniform,
                          const vkb::Swapchain &swapchain,
                          const std::vector<VkImageView> &image_views,
+                         const VkBuffer &uniform_buffer,
                          const VkDescriptorSetLayout &set_layout,
                          const VkDescriptorPool &descriptor_pool,
                          std::vector<VkDescriptorSet> &descriptor_sets) {
@@ -436,15 +890,14 @@ allocate_descriptor_sets(const vkb::Device &device,
         return -1;
     }
     std::vector<VkDescriptorImageInfo> image_info{swapchain.image_count};
-    std::vector<VkDescriptorBufferInfo> buffer_info{swapchain.image_count};
+    VkDescriptorBufferInfo buffer_info{
+        .buffer = uniform_buffer, .offset = 0, .range = sizeof(MainConstants)};
     std::vector<VkWriteDescriptorSet> descriptor_writes{swapchain.image_count *
                                                         2};
     for (auto i = 0; i < swapchain.image_count; ++i) {
         image_info[i] = {.imageView = image_views[i],
                          .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
-        buffer_info[i] = {
-            .buffer = buffer_uniform, .offset = 0, .range = VK_WHOLE_SIZE};
-        descriptor_writes[i * 2 + 0] = {
+        descriptor_writes[i * 2] = {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .pNext = nullptr,
             .dstSet = descriptor_sets[i],
@@ -462,9 +915,9 @@ allocate_descriptor_sets(const vkb::Device &device,
             .dstBinding = 1,
             .dstArrayElement = 0,
             .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
             .pImageInfo = nullptr,
-            .pBufferInfo = &buffer_info[i],
+            .pBufferInfo = &buffer_info,
             .pTexelBufferView = nullptr};
     }
     vkUpdateDescriptorSets(device.device, descriptor_writes.size(),
@@ -472,16 +925,36 @@ allocate_descriptor_sets(const vkb::Device &device,
     return {};
 }
 
-std::optional<int> allocate_command_buffers(
-    SDL_Window *&window, const vkb::Device &device, const uint32_t &queue_index,
-    const VkCommandPool &command_pool, const vkb::Swapchain &swapchain,
-    std::vector<VkCommandBuffer> &command_buffers) {
-    command_buffers = std::vector<VkCommandBuffer>{swapchain.image_count};
+void update_descriptor_set(const vkb::Device &device,
+                           const VkImageView &image_view,
+                           const VkDescriptorSet &descriptor_set) {
+    VkDescriptorImageInfo image_info{.imageView = image_view,
+                                     .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+    VkWriteDescriptorSet descriptor_write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = descriptor_set,
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .pImageInfo = &image_info,
+        .pBufferInfo = nullptr,
+        .pTexelBufferView = nullptr};
+    vkUpdateDescriptorSets(device.device, 1, &descriptor_write, 0, nullptr);
+}
+
+std::optional<int>
+allocate_command_buffers(const vkb::Device &device,
+                         const VkCommandPool &command_pool,
+                         const uint32_t &count,
+                         std::vector<VkCommandBuffer> &command_buffers) {
+    command_buffers = std::vector<VkCommandBuffer>{count};
     VkCommandBufferAllocateInfo allocate_info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .commandPool = command_pool,
         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = swapchain.image_count};
+        .commandBufferCount = count};
     if (vkAllocateCommandBuffers(device.device, &allocate_info,
                                  command_buffers.data()) != VK_SUCCESS) {
         return -1;
@@ -489,38 +962,1073 @@ std::optional<int> allocate_command_buffers(
     return {};
 }
 
-std::optional<int> imgui_initialize(
-    SDL_Window *&window, vkb::Instance &instance,
-    const vkb::PhysicalDevice &physical_device, const vkb::Device &device,
-    const VkQueue &queue, const uint32_t &queue_index,
-    const VkDescriptorPool &descriptor_pool, const vkb::Swapchain &swapchain,
-    const VkRenderPass &render_pass, const VkCommandBuffer &command_buffer,
-    ImGuiIO &imgui_io) {
-    ImGui::CreateContext();
-    imgui_io = ImGui::GetIO();
-    ImGui::StyleColorsDark();
-    ImGui_ImplSDL2_InitForVulkan(window);
-    ImGui_ImplVulkan_LoadFunctions(
-        [](const char *function_name, void *instance) {
-            return vkGetInstanceProcAddr(*static_cast<VkInstance *>(instance),
-                                         function_name);
-        },
-        static_cast<void *>(&instance.instance));
-    ImGui_ImplVulkan_InitInfo init_info = {};
-    init_info.Instance = instance.instance;
-    init_info.PhysicalDevice = physical_device.physical_device;
-    init_info.Device = device.device;
-    init_info.QueueFamily = queue_index;
-    init_info.Queue = queue;
-    init_info.DescriptorPool = descriptor_pool;
-    init_info.MinImageCount = swapchain.image_count;
-    init_info.ImageCount = swapchain.image_count;
-    if (!ImGui_ImplVulkan_Init(&init_info, render_pass)) {
-        return -1;
-    }
-    VkCommandBufferBeginInfo begin_info = {};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+std::optional<int> allocate_command_buffers(
+    SDL_Window *&window, const vkb::Device &device, const uint32_t &queue_index,
+    const VkCommandPool &command_pool, const vkb::Swapchain &swapchain,
+    std::vector<VkCommandBuffer> &command_buffers) {
+    return allocate_command_buffers(device, command_pool, swapchain.image_count,
+                                    command_buffers);
+}
+
+struct Recorder {
+    uint32_t worker_count;
+    std::vector<VkCommandPool> command_pools;
+    std::vector<std::vector<VkCommandBuffer>> command_buffers;
+    std::vector<uint32_t> used;
+    std::vector<std::vector<VkCommandBuffer>> recorded;
+};
+
+std::optional<int> create_recorder(const vkb::Device &device,
+                                   const uint32_t &queue_index,
+                                   const uint32_t &slots,
+                                   const uint32_t &parallelism,
+                                   Recorder &recorder) {
+    recorder.worker_count = std::max(
+        std::min(get_work_stealing_pool().worker_count, parallelism), 1u);
+    auto count = slots * recorder.worker_count;
+    recorder.command_pools = std::vector<VkCommandPool>(count, VK_NULL_HANDLE);
+    recorder.command_buffers = std::vector<std::vector<VkCommandBuffer>>(count);
+    recorder.used = std::vector<uint32_t>(count, 0);
+    recorder.recorded = std::vector<std::vector<VkCommandBuffer>>(slots);
+    VkCommandPoolCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queue_index};
+    for (auto &command_pool : recorder.command_pools) {
+        if (vkCreateCommandPool(device.device, &create_info, nullptr,
+                                &command_pool) != VK_SUCCESS) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+void destroy_recorder(const vkb::Device &device, Recorder &recorder) {
+    for (auto &command_pool : recorder.command_pools) {
+        vkDestroyCommandPool(device.device, command_pool, nullptr);
+    }
+    recorder = {};
+}
+
+std::optional<int> recorder_reset(const vkb::Device &device,
+                                  Recorder &recorder, const uint32_t &slot) {
+    for (auto i = slot * recorder.worker_count;
+         i < (slot + 1) * recorder.worker_count; ++i) {
+        if (vkResetCommandPool(device.device, recorder.command_pools[i], 0) !=
+            VK_SUCCESS) {
+            return -1;
+        }
+        recorder.used[i] = 0;
+    }
+    return {};
+}
+
+// Record i goes to pool i of the slot, so concurrent records never share a
+// pool and a single record stays on the calling thread.
+template <typename F>
+std::optional<int> recorder_record(const vkb::Device &device,
+                                   Recorder &recorder, const uint32_t &slot,
+                                   const uint32_t &count, F &&commands) {
+    if (count > recorder.worker_count) {
+        return -1;
+    }
+    auto &command_buffers = recorder.recorded[slot];
+    command_buffers.resize(count);
+    auto record = [&](const uint32_t &i) -> std::optional<int> {
+        auto pool = slot * recorder.worker_count + i;
+        auto &buffers = recorder.command_buffers[pool];
+        auto &used = recorder.used[pool];
+        if (used == buffers.size()) {
+            VkCommandBufferAllocateInfo allocate_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = recorder.command_pools[pool],
+                .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                .commandBufferCount = 1};
+            VkCommandBuffer command_buffer;
+            if (vkAllocateCommandBuffers(device.device, &allocate_info,
+                                         &command_buffer) != VK_SUCCESS) {
+                return -1;
+            }
+            buffers.push_back(command_buffer);
+        }
+        auto &command_buffer = buffers[used++];
+        VkCommandBufferInheritanceInfo inheritance_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .renderPass = VK_NULL_HANDLE,
+            .subpass = 0,
+            .framebuffer = VK_NULL_HANDLE};
+        VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = 0,
+            .pInheritanceInfo = &inheritance_info};
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            return -1;
+        }
+        if (auto error = commands(i, command_buffer)) {
+            return -1;
+        }
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            return -1;
+        }
+        command_buffers[i] = command_buffer;
+        return {};
+    };
+    if (count <= 1) {
+        if (count == 1) {
+            return record(0);
+        }
+        return {};
+    }
+    std::atomic<bool> failed = false;
+    parallel_for(count, 1, [&](uint64_t begin, uint64_t end) {
+        for (auto i = begin; i < end && !failed; ++i) {
+            if (auto error = record(i)) {
+                failed = true;
+            }
+        }
+    });
+    if (failed) {
+        return -1;
+    }
+    return {};
+}
+
+std::optional<int>
+create_buffer(const VmaAllocator &allocator, const VkDeviceSize &size,
+              const VkBufferUsageFlags &usage,
+              const std::vector<uint32_t> &queue_indices,
+              const VkMemoryPropertyFlags &required_flags,
+              const VkMemoryPropertyFlags &preferred_flags,
+              const VmaAllocationCreateFlags &allocation_flags,
+              VkBuffer &buffer, VmaAllocation &allocation,
+              VmaAllocationInfo &allocation_info) {
+    std::vector<uint32_t> unique_indices;
+    for (auto &queue_index : queue_indices) {
+        if (std::find(unique_indices.begin(), unique_indices.end(),
+                      queue_index) == unique_indices.end()) {
+            unique_indices.push_back(queue_index);
+        }
+    }
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_create_info.size = size;
+    buffer_create_info.usage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                               VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (unique_indices.size() > 1) {
+        buffer_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_create_info.queueFamilyIndexCount =
+            static_cast<uint32_t>(unique_indices.size());
+        buffer_create_info.pQueueFamilyIndices = unique_indices.data();
+    } else {
+        buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    VmaAllocationCreateInfo allocation_create_info = {};
+    allocation_create_info.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    allocation_create_info.flags = allocation_flags;
+    allocation_create_info.requiredFlags = required_flags;
+    allocation_create_info.preferredFlags = preferred_flags;
+    if (vmaCreateBuffer(allocator, &buffer_create_info, &allocation_create_info,
+                        &buffer, &allocation, &allocation_info) != VK_SUCCESS) {
+        return -1;
+    }
+    return {};
+}
+
+std::optional<int>
+create_buffer_device(const VmaAllocator &allocator, const VkDeviceSize &size,
+                     const VkBufferUsageFlags &usage,
+                     const std::vector<uint32_t> &queue_indices,
+                     VkBuffer &buffer, VmaAllocation &allocation,
+                     VmaAllocationInfo &allocation_info) {
+    return create_buffer(allocator, size, usage, queue_indices,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, 0, buffer,
+                         allocation, allocation_info);
+}
+
+std::optional<int>
+create_buffer_host(const VmaAllocator &allocator, const VkDeviceSize &size,
+                   const VkBufferUsageFlags &usage,
+                   const std::vector<uint32_t> &queue_indices,
+                   VkBuffer &buffer, VmaAllocation &allocation,
+                   VmaAllocationInfo &allocation_info) {
+    return create_buffer(allocator, size, usage, queue_indices,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                         0, VMA_ALLOCATION_CREATE_MAPPED_BIT, buffer,
+                         allocation, allocation_info);
+}
+
+struct Arena {
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    VmaAllocationInfo allocation_info;
+    VmaVirtualBlock block;
+    VkDeviceSize alignment;
+};
+
+VkDeviceSize get_arena_alignment(const vkb::PhysicalDevice &physical_device) {
+    auto &limits = physical_device.properties.limits;
+    return std::max<VkDeviceSize>({limits.minStorageBufferOffsetAlignment,
+                                   limits.minUniformBufferOffsetAlignment, 16});
+}
+
+std::optional<int> create_arena(const vkb::PhysicalDevice &physical_device,
+                                const VmaAllocator &allocator,
+                                const VkDeviceSize &size,
+                                const VkBufferUsageFlags &usage,
+                                const std::vector<uint32_t> &queue_indices,
+                                const bool &host, Arena &arena) {
+    // The whole arena is bound as one storage buffer
+    if ((usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) &&
+        size > physical_device.properties.limits.maxStorageBufferRange) {
+        return -1;
+    }
+    arena.alignment = get_arena_alignment(physical_device);
+    if (host) {
+        if (auto error = create_buffer_host(allocator, size, usage,
+                                            queue_indices, arena.buffer,
+                                            arena.allocation,
+                                            arena.allocation_info)) {
+            return -1;
+        }
+    } else {
+        if (auto error = create_buffer_device(allocator, size, usage,
+                                              queue_indices, arena.buffer,
+                                              arena.allocation,
+                                              arena.allocation_info)) {
+            return -1;
+        }
+    }
+    VmaVirtualBlockCreateInfo block_create_info = {};
+    block_create_info.size = size;
+    if (vmaCreateVirtualBlock(&block_create_info, &arena.block) !=
+        VK_SUCCESS) {
+        vmaDestroyBuffer(allocator, arena.buffer, arena.allocation);
+        return -1;
+    }
+    return {};
+}
+
+void destroy_arena(const VmaAllocator &allocator, Arena &arena) {
+    vmaClearVirtualBlock(arena.block);
+    vmaDestroyVirtualBlock(arena.block);
+    vmaDestroyBuffer(allocator, arena.buffer, arena.allocation);
+    arena = {};
+}
+
+std::optional<int> arena_allocate(Arena &arena, const VkDeviceSize &size,
+                                  VkDeviceSize &offset,
+                                  VmaVirtualAllocation *allocation = nullptr) {
+    VmaVirtualAllocationCreateInfo allocation_create_info = {};
+    allocation_create_info.size = size;
+    allocation_create_info.alignment = arena.alignment;
+    VmaVirtualAllocation virtual_allocation;
+    if (vmaVirtualAllocate(arena.block, &allocation_create_info,
+                           &virtual_allocation, &offset) != VK_SUCCESS) {
+        return -1;
+    }
+    if (allocation) {
+        *allocation = virtual_allocation;
+    }
+    return {};
+}
+
+void arena_free(Arena &arena, const VmaVirtualAllocation &allocation) {
+    vmaVirtualFree(arena.block, allocation);
+}
+
+void arena_reset(Arena &arena) { vmaClearVirtualBlock(arena.block); }
+
+struct UniformRing {
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    VmaAllocationInfo allocation_info;
+    VkDeviceSize alignment;
+    VkDeviceSize size;
+    VkDeviceSize head, tail;
+};
+
+std::optional<int>
+create_uniform_ring(const vkb::PhysicalDevice &physical_device,
+                    const VmaAllocator &allocator, const uint32_t &slots,
+                    const VkDeviceSize &size, UniformRing &ring) {
+    ring.alignment = std::max<VkDeviceSize>(
+        physical_device.properties.limits.minUniformBufferOffsetAlignment,
+        16);
+    ring.size = (size + ring.alignment - 1) / ring.alignment * ring.alignment;
+    ring.head = ring.tail = 0;
+    if (auto error = create_buffer_uniform(allocator, ring.size * slots,
+                                           ring.buffer, ring.allocation,
+                                           ring.allocation_info)) {
+        if (auto error = create_buffer_host(
+                allocator, ring.size * slots,
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, {}, ring.buffer,
+                ring.allocation, ring.allocation_info)) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+void destroy_uniform_ring(const VmaAllocator &allocator, UniformRing &ring) {
+    vmaDestroyBuffer(allocator, ring.buffer, ring.allocation);
+    ring = {};
+}
+
+void uniform_ring_begin(UniformRing &ring, const uint32_t &slot) {
+    ring.head = ring.size * slot;
+    ring.tail = ring.head + ring.size;
+}
+
+std::optional<int> uniform_ring_allocate(UniformRing &ring, const void *data,
+                                         const VkDeviceSize &size,
+                                         uint32_t &offset) {
+    auto aligned =
+        (size + ring.alignment - 1) / ring.alignment * ring.alignment;
+    if (ring.head + aligned > ring.tail) {
+        return -1;
+    }
+    std::memcpy(static_cast<char *>(ring.allocation_info.pMappedData) +
+                    ring.head,
+                data, size);
+    offset = static_cast<uint32_t>(ring.head);
+    ring.head += aligned;
+    return {};
+}
+
+struct StagingDownload {
+    void *data;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    std::function<void()> complete;
+};
+
+struct StagingRing {
+    VmaAllocator allocator = VK_NULL_HANDLE;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    VkDeviceSize used = 0;
+    uint32_t index = 0;
+    bool recording = false;
+    std::vector<VkBuffer> buffers;
+    std::vector<VmaAllocation> allocations;
+    std::vector<VmaAllocationInfo> allocation_infos;
+    std::vector<VkCommandBuffer> command_buffers;
+    std::vector<VkFence> fences;
+    std::vector<VkSemaphore> semaphores;
+    std::vector<std::vector<StagingDownload>> downloads;
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<VkPipelineStageFlags> wait_stages;
+};
+
+std::optional<int> create_staging_ring(const vkb::Device &device,
+                                       const VmaAllocator &allocator,
+                                       const uint32_t &queue_index,
+                                       const uint32_t &count,
+                                       const VkDeviceSize &size,
+                                       StagingRing &ring) {
+    ring.allocator = allocator;
+    ring.size = size;
+    ring.buffers = std::vector<VkBuffer>{count};
+    ring.allocations = std::vector<VmaAllocation>{count};
+    ring.allocation_infos = std::vector<VmaAllocationInfo>{count};
+    ring.downloads = std::vector<std::vector<StagingDownload>>{count};
+    if (auto error = create_command_pool(device, queue_index,
+                                         ring.command_pool)) {
+        return -1;
+    }
+    if (auto error = allocate_command_buffers(device, ring.command_pool, count,
+                                              ring.command_buffers)) {
+        return -1;
+    }
+    if (auto error = create_fences(device, count, ring.fences)) {
+        return -1;
+    }
+    if (auto error = create_semaphores(device, count, ring.semaphores)) {
+        return -1;
+    }
+    for (auto i = 0; i < count; ++i) {
+        if (auto error = create_buffer(
+                allocator, size, 0, {queue_index},
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                VMA_ALLOCATION_CREATE_MAPPED_BIT, ring.buffers[i],
+                ring.allocations[i], ring.allocation_infos[i])) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+void destroy_staging_ring(const vkb::Device &device,
+                          const VmaAllocator &allocator, StagingRing &ring) {
+    for (auto i = 0; i < ring.buffers.size(); ++i) {
+        vmaDestroyBuffer(allocator, ring.buffers[i], ring.allocations[i]);
+    }
+    for (auto &semaphore : ring.semaphores) {
+        vkDestroySemaphore(device.device, semaphore, nullptr);
+    }
+    for (auto &fence : ring.fences) {
+        vkDestroyFence(device.device, fence, nullptr);
+    }
+    vkFreeCommandBuffers(device.device, ring.command_pool,
+                         ring.command_buffers.size(),
+                         ring.command_buffers.data());
+    vkDestroyCommandPool(device.device, ring.command_pool, nullptr);
+    ring = {};
+}
+
+std::optional<int> staging_complete(StagingRing &ring, const uint32_t &index) {
+    auto mapped = static_cast<char *>(ring.allocation_infos[index].pMappedData);
+    for (auto &download : ring.downloads[index]) {
+        if (vmaInvalidateAllocation(ring.allocator, ring.allocations[index],
+                                    download.offset,
+                                    download.size) != VK_SUCCESS) {
+            return -1;
+        }
+        memcpy(download.data, mapped + download.offset, download.size);
+        if (download.complete) {
+            download.complete();
+        }
+    }
+    ring.downloads[index].clear();
+    return {};
+}
+
+std::optional<int> staging_begin(const vkb::Device &device, StagingRing &ring) {
+    if (ring.recording) {
+        return {};
+    }
+    auto &fence = ring.fences[ring.index];
+    if (vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX) !=
+        VK_SUCCESS) {
+        return -1;
+    }
+    if (auto error = staging_complete(ring, ring.index)) {
+        return -1;
+    }
+    if (vkResetFences(device.device, 1, &fence) != VK_SUCCESS) {
+        return -1;
+    }
+    auto &command_buffer = ring.command_buffers[ring.index];
+    if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
+        return -1;
+    }
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        return -1;
+    }
+    VkMemoryBarrier memory_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask =
+            VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT};
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier,
+                         0, nullptr, 0, nullptr);
+    ring.used = 0;
+    ring.recording = true;
+    return {};
+}
+
+std::optional<int> staging_submit(const vkb::Device &device,
+                                  const VkQueue &queue, StagingRing &ring,
+                                  VkSemaphore *signal_semaphore = nullptr) {
+    if (auto error = staging_begin(device, ring)) {
+        return -1;
+    }
+    auto &command_buffer = ring.command_buffers[ring.index];
+    if (!ring.downloads[ring.index].empty()) {
+        VkMemoryBarrier memory_barrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT};
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                             &memory_barrier, 0, nullptr, 0, nullptr);
+    }
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        return -1;
+    }
+    if (vmaFlushAllocation(ring.allocator, ring.allocations[ring.index], 0,
+                           ring.used) != VK_SUCCESS) {
+        return -1;
+    }
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount =
+            static_cast<uint32_t>(ring.wait_semaphores.size()),
+        .pWaitSemaphores = ring.wait_semaphores.data(),
+        .pWaitDstStageMask = ring.wait_stages.data(),
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+        .signalSemaphoreCount = signal_semaphore ? 1u : 0u,
+        .pSignalSemaphores = &ring.semaphores[ring.index]};
+    if (vkQueueSubmit(queue, 1, &submit_info, ring.fences[ring.index]) !=
+        VK_SUCCESS) {
+        return -1;
+    }
+    if (signal_semaphore) {
+        *signal_semaphore = ring.semaphores[ring.index];
+    }
+    ring.wait_semaphores.clear();
+    ring.wait_stages.clear();
+    ring.recording = false;
+    ring.index = (ring.index + 1) % ring.buffers.size();
+    return {};
+}
+
+void staging_wait_semaphore(StagingRing &ring, const VkSemaphore &semaphore,
+                            const VkPipelineStageFlags &stage) {
+    ring.wait_semaphores.push_back(semaphore);
+    ring.wait_stages.push_back(stage);
+}
+
+std::optional<int> staging_reserve(const vkb::Device &device,
+                                   const VkQueue &queue, StagingRing &ring,
+                                   const VkDeviceSize &size,
+                                   VkDeviceSize &offset,
+                                   VkDeviceSize &reserved) {
+    if (ring.recording && ring.used == ring.size) {
+        if (auto error = staging_submit(device, queue, ring)) {
+            return -1;
+        }
+    }
+    if (auto error = staging_begin(device, ring)) {
+        return -1;
+    }
+    offset = ring.used;
+    reserved = std::min(size, ring.size - ring.used);
+    ring.used = std::min((ring.used + reserved + 15) & ~VkDeviceSize{15},
+                         ring.size);
+    return {};
+}
+
+std::optional<int> staging_upload(const vkb::Device &device,
+                                  const VkQueue &queue, StagingRing &ring,
+                                  const void *data, const VkDeviceSize &size,
+                                  const VkBuffer &buffer,
+                                  const VkDeviceSize &offset) {
+    for (VkDeviceSize done = 0; done < size;) {
+        VkDeviceSize staging_offset, reserved;
+        if (auto error = staging_reserve(device, queue, ring, size - done,
+                                         staging_offset, reserved)) {
+            return -1;
+        }
+        memcpy(static_cast<char *>(
+                   ring.allocation_infos[ring.index].pMappedData) +
+                   staging_offset,
+               static_cast<const char *>(data) + done, reserved);
+        VkBufferCopy region{.srcOffset = staging_offset,
+                            .dstOffset = offset + done,
+                            .size = reserved};
+        vkCmdCopyBuffer(ring.command_buffers[ring.index],
+                        ring.buffers[ring.index], buffer, 1, &region);
+        done += reserved;
+    }
+    return {};
+}
+
+std::optional<int> staging_download(const vkb::Device &device,
+                                    const VkQueue &queue, StagingRing &ring,
+                                    const VkBuffer &buffer,
+                                    const VkDeviceSize &offset,
+                                    const VkDeviceSize &size, void *data,
+                                    std::function<void()> complete = {}) {
+    for (VkDeviceSize done = 0; done < size;) {
+        VkDeviceSize staging_offset, reserved;
+        if (auto error = staging_reserve(device, queue, ring, size - done,
+                                         staging_offset, reserved)) {
+            return -1;
+        }
+        VkBufferCopy region{.srcOffset = offset + done,
+                            .dstOffset = staging_offset,
+                            .size = reserved};
+        vkCmdCopyBuffer(ring.command_buffers[ring.index], buffer,
+                        ring.buffers[ring.index], 1, &region);
+        done += reserved;
+        ring.downloads[ring.index].push_back(
+            {static_cast<char *>(data) + done - reserved, staging_offset,
+             reserved, done == size ? complete : std::function<void()>{}});
+    }
+    return {};
+}
+
+std::optional<int> staging_finish(const vkb::Device &device,
+                                  const VkQueue &queue, StagingRing &ring) {
+    if (ring.recording) {
+        if (auto error = staging_submit(device, queue, ring)) {
+            return -1;
+        }
+    }
+    if (vkWaitForFences(device.device, ring.fences.size(), ring.fences.data(),
+                        VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+        return -1;
+    }
+    for (auto i = 0; i < ring.buffers.size(); ++i) {
+        if (auto error = staging_complete(
+                ring, (ring.index + i) % ring.buffers.size())) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+std::optional<int> staging_copy(const vkb::Device &device, StagingRing &ring,
+                                const VkBuffer &source,
+                                const VkDeviceSize &source_offset,
+                                const VkBuffer &destination,
+                                const VkDeviceSize &destination_offset,
+                                const VkDeviceSize &size) {
+    if (auto error = staging_begin(device, ring)) {
+        return -1;
+    }
+    VkBufferCopy region{.srcOffset = source_offset,
+                        .dstOffset = destination_offset,
+                        .size = size};
+    vkCmdCopyBuffer(ring.command_buffers[ring.index], source, destination, 1,
+                    &region);
+    return {};
+}
+
+// Slots are submitted round robin from ring.index, so walking from the oldest
+// and stopping at the first unsignaled one completes downloads in submission
+// order and a split download's callback runs after all of its pieces landed.
+std::optional<int> staging_poll(const vkb::Device &device, StagingRing &ring) {
+    for (auto i = ring.recording ? 1 : 0; i < ring.buffers.size(); ++i) {
+        auto index = (ring.index + i) % ring.buffers.size();
+        if (ring.downloads[index].empty()) {
+            continue;
+        }
+        auto result = vkGetFenceStatus(device.device, ring.fences[index]);
+        if (result == VK_NOT_READY) {
+            break;
+        } else if (result != VK_SUCCESS) {
+            return -1;
+        }
+        if (auto error = staging_complete(ring, index)) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct MappedFile {
+    void *data = nullptr;
+    size_t size = 0;
+    size_t mapped_size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
+
+std::optional<int> map_file(const char *path, const size_t &size,
+                            const bool &writable, MappedFile &file) {
+    file.size = size;
+#ifdef _WIN32
+    file.file = CreateFileA(
+        path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+        FILE_SHARE_READ, nullptr, writable ? OPEN_ALWAYS : OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file.file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file.file, &file_size) ||
+        (!writable && file_size.QuadPart < size)) {
+        CloseHandle(file.file);
+        return -1;
+    }
+    file.mapping = CreateFileMappingA(
+        file.file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+        DWORD(uint64_t(size) >> 32), DWORD(size), nullptr);
+    if (!file.mapping) {
+        CloseHandle(file.file);
+        return -1;
+    }
+    file.data = MapViewOfFile(file.mapping,
+                              writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0,
+                              size);
+    if (!file.data) {
+        CloseHandle(file.mapping);
+        CloseHandle(file.file);
+        return -1;
+    }
+#else
+    file.descriptor = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (file.descriptor < 0) {
+        return -1;
+    }
+    struct stat status;
+    if (fstat(file.descriptor, &status) != 0 ||
+        (writable ? ftruncate(file.descriptor, size) != 0
+                  : size_t(status.st_size) < size)) {
+        close(file.descriptor);
+        return -1;
+    }
+    file.data =
+        mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+             MAP_SHARED, file.descriptor, 0);
+    if (file.data == MAP_FAILED) {
+        close(file.descriptor);
+        return -1;
+    }
+    madvise(file.data, size, MADV_SEQUENTIAL);
+#endif
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    size_t page_size = system_info.dwPageSize;
+#else
+    size_t page_size = sysconf(_SC_PAGESIZE);
+#endif
+    file.mapped_size = (size + page_size - 1) / page_size * page_size;
+    return {};
+}
+
+void unmap_file(MappedFile &file) {
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle(file.mapping);
+    CloseHandle(file.file);
+#else
+    munmap(file.data, file.size);
+    close(file.descriptor);
+#endif
+    file = {};
+}
+
+struct HostImport {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+};
+
+std::optional<int>
+create_host_import(const vkb::PhysicalDevice &physical_device,
+                   const vkb::Device &device, const MappedFile &file,
+                   const VkBufferUsageFlags &usage, HostImport &import) {
+    if (!physical_device.is_extension_present(
+            VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+        return -1;
+    }
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties = {
+        .sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT};
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &host_properties};
+    vkGetPhysicalDeviceProperties2(physical_device.physical_device,
+                                   &properties);
+    auto alignment = host_properties.minImportedHostPointerAlignment;
+    auto address = reinterpret_cast<uintptr_t>(file.data);
+    auto base = address / alignment * alignment;
+    import.offset = address - base;
+    auto length =
+        (import.offset + file.size + alignment - 1) / alignment * alignment;
+    if (base < address || base + length > address + file.mapped_size) {
+        return -1;
+    }
+    auto pointer = reinterpret_cast<void *>(base);
+    VkMemoryHostPointerPropertiesEXT pointer_properties = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT};
+    if (vkGetMemoryHostPointerPropertiesEXT(
+            device.device,
+            VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer,
+            &pointer_properties) != VK_SUCCESS) {
+        return -1;
+    }
+    VkExternalMemoryBufferCreateInfo external_info = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT};
+    VkBufferCreateInfo buffer_create_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = &external_info,
+        .size = length,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+    if (vkCreateBuffer(device.device, &buffer_create_info, nullptr,
+                       &import.buffer) != VK_SUCCESS) {
+        return -1;
+    }
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, import.buffer, &requirements);
+    auto memory_type_bits =
+        requirements.memoryTypeBits & pointer_properties.memoryTypeBits;
+    uint32_t memory_type_index = 0;
+    while (memory_type_index < 32 &&
+           !(memory_type_bits & (1u << memory_type_index))) {
+        ++memory_type_index;
+    }
+    VkImportMemoryHostPointerInfoEXT import_info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+        .pHostPointer = pointer};
+    VkMemoryAllocateInfo allocate_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &import_info,
+        .allocationSize = length,
+        .memoryTypeIndex = memory_type_index};
+    if (memory_type_index == 32 ||
+        vkAllocateMemory(device.device, &allocate_info, nullptr,
+                         &import.memory) != VK_SUCCESS) {
+        vkDestroyBuffer(device.device, import.buffer, nullptr);
+        import = {};
+        return -1;
+    }
+    if (vkBindBufferMemory(device.device, import.buffer, import.memory, 0) !=
+        VK_SUCCESS) {
+        vkFreeMemory(device.device, import.memory, nullptr);
+        vkDestroyBuffer(device.device, import.buffer, nullptr);
+        import = {};
+        return -1;
+    }
+    return {};
+}
+
+void destroy_host_import(const vkb::Device &device, HostImport &import) {
+    vkDestroyBuffer(device.device, import.buffer, nullptr);
+    vkFreeMemory(device.device, import.memory, nullptr);
+    import = {};
+}
+
+struct ProfilerRegion {
+    std::string name;
+    uint64_t bytes;
+    VkFence fence;
+};
+
+struct ProfilerResult {
+    std::string name;
+    double begin, duration;
+    uint64_t invocations, bytes;
+};
+
+struct Profiler {
+    VkQueryPool timestamp_pool = VK_NULL_HANDLE;
+    VkQueryPool statistics_pool = VK_NULL_HANDLE;
+    double timestamp_period;
+    uint64_t timestamp_mask;
+    uint64_t origin = 0;
+    uint64_t head = 0, tail = 0, submitted = 0;
+    std::vector<ProfilerRegion> regions;
+    std::vector<ProfilerResult> results;
+};
+
+std::optional<int> create_profiler(const vkb::PhysicalDevice &physical_device,
+                                   const vkb::Device &device,
+                                   const uint32_t &queue_index,
+                                   const uint32_t &capacity,
+                                   Profiler &profiler) {
+    auto valid_bits = device.queue_families[queue_index].timestampValidBits;
+    if (valid_bits == 0) {
+        return -1;
+    }
+    profiler.timestamp_period =
+        physical_device.properties.limits.timestampPeriod;
+    profiler.timestamp_mask =
+        valid_bits >= 64 ? UINT64_MAX : (uint64_t{1} << valid_bits) - 1;
+    profiler.regions = std::vector<ProfilerRegion>{capacity};
+    VkQueryPoolCreateInfo timestamp_info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = capacity * 2};
+    if (vkCreateQueryPool(device.device, &timestamp_info, nullptr,
+                          &profiler.timestamp_pool) != VK_SUCCESS) {
+        return -1;
+    }
+    if (physical_device.features.pipelineStatisticsQuery) {
+        VkQueryPoolCreateInfo statistics_info = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = capacity,
+            .pipelineStatistics =
+                VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT};
+        if (vkCreateQueryPool(device.device, &statistics_info, nullptr,
+                              &profiler.statistics_pool) != VK_SUCCESS) {
+            return -1;
+        }
+    }
+    return {};
+}
+
+void destroy_profiler(const vkb::Device &device, Profiler &profiler) {
+    if (profiler.statistics_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device.device, profiler.statistics_pool, nullptr);
+    }
+    vkDestroyQueryPool(device.device, profiler.timestamp_pool, nullptr);
+    profiler = {};
+}
+
+void profiler_begin(Profiler &profiler, const VkCommandBuffer &command_buffer,
+                    const std::string &name, const uint64_t &bytes,
+                    uint32_t &region) {
+    if (profiler.head - profiler.tail == profiler.regions.size()) {
+        region = UINT32_MAX;
+        return;
+    }
+    region = profiler.head++ % profiler.regions.size();
+    profiler.regions[region] = {name, bytes, VK_NULL_HANDLE};
+    vkCmdResetQueryPool(command_buffer, profiler.timestamp_pool, region * 2,
+                        2);
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        profiler.timestamp_pool, region * 2);
+    if (profiler.statistics_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, profiler.statistics_pool, region,
+                            1);
+        vkCmdBeginQuery(command_buffer, profiler.statistics_pool, region, 0);
+    }
+}
+
+void profiler_end(Profiler &profiler, const VkCommandBuffer &command_buffer,
+                  const uint32_t &region) {
+    if (region == UINT32_MAX) {
+        return;
+    }
+    if (profiler.statistics_pool != VK_NULL_HANDLE) {
+        vkCmdEndQuery(command_buffer, profiler.statistics_pool, region);
+    }
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        profiler.timestamp_pool, region * 2 + 1);
+}
+
+void profiler_submit(Profiler &profiler, const VkFence &fence) {
+    for (; profiler.submitted < profiler.head; ++profiler.submitted) {
+        profiler.regions[profiler.submitted % profiler.regions.size()].fence =
+            fence;
+    }
+}
+
+// A region is read back only once the fence of its submission signaled, so
+// a reused slot never reports availability left over from its previous lap.
+std::optional<int> profiler_resolve(const vkb::Device &device,
+                                    Profiler &profiler,
+                                    const bool &idle = false) {
+    auto flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+    for (; profiler.tail < profiler.submitted; ++profiler.tail) {
+        uint32_t region = profiler.tail % profiler.regions.size();
+        if (!idle) {
+            auto result = vkGetFenceStatus(
+                device.device, profiler.regions[region].fence);
+            if (result == VK_NOT_READY) {
+                break;
+            } else if (result != VK_SUCCESS) {
+                return -1;
+            }
+        }
+        uint64_t timestamps[4];
+        if (auto result = vkGetQueryPoolResults(
+                device.device, profiler.timestamp_pool, region * 2, 2,
+                sizeof(timestamps), timestamps, sizeof(uint64_t) * 2, flags);
+            result != VK_SUCCESS && result != VK_NOT_READY) {
+            return -1;
+        }
+        if (!timestamps[1] || !timestamps[3]) {
+            break;
+        }
+        uint64_t statistics[2] = {0, 1};
+        if (profiler.statistics_pool != VK_NULL_HANDLE) {
+            if (auto result = vkGetQueryPoolResults(
+                    device.device, profiler.statistics_pool, region, 1,
+                    sizeof(statistics), statistics, sizeof(statistics), flags);
+                result != VK_SUCCESS && result != VK_NOT_READY) {
+                return -1;
+            }
+            if (!statistics[1]) {
+                break;
+            }
+        }
+        if (profiler.results.empty()) {
+            profiler.origin = timestamps[0];
+        }
+        auto ticks = [&](const uint64_t &from, const uint64_t &to) {
+            return ((to - from) & profiler.timestamp_mask) *
+                   profiler.timestamp_period / 1000.;
+        };
+        auto &[name, bytes, fence] = profiler.regions[region];
+        profiler.results.push_back(
+            {name, ticks(profiler.origin, timestamps[0]),
+             ticks(timestamps[0], timestamps[2]), statistics[0], bytes});
+    }
+    return {};
+}
+
+std::optional<int> profiler_export(const Profiler &profiler,
+                                   const char *&path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        return -1;
+    }
+    file << "{\"traceEvents\":[";
+    for (auto i = 0; i < profiler.results.size(); ++i) {
+        auto &result = profiler.results[i];
+        file << (i ? ",\n" : "\n") << "{\"name\":\"" << result.name
+             << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":"
+             << result.begin << ",\"dur\":" << result.duration
+             << ",\"args\":{\"invocations\":" << result.invocations
+             << ",\"bytes\":" << result.bytes << ",\"gbps\":"
+             << (result.duration > 0. ? result.bytes / result.duration / 1e3
+                                      : 0.)
+             << "}}";
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    if (!file) {
+        return -1;
+    }
+    return {};
+}
+
+std::optional<int> imgui_initialize(
+    SDL_Window *&window, vkb::Instance &instance,
+    const vkb::PhysicalDevice &physical_device, const vkb::Device &device,
+    const VkQueue &queue, const uint32_t &queue_index,
+    const VkDescriptorPool &descriptor_pool, const vkb::Swapchain &swapchain,
+    const VkRenderPass &render_pass, const VkCommandBuffer &command_buffer,
+    ImGuiIO &imgui_io) {
+    ImGui::CreateContext();
+    imgui_io = ImGui::GetIO();
+    ImGui::StyleColorsDark();
+    ImGui_ImplSDL2_InitForVulkan(window);
+    ImGui_ImplVulkan_LoadFunctions(
+        [](const char *function_name, void *instance) {
+            return vkGetInstanceProcAddr(*static_cast<VkInstance *>(instance),
+                                         function_name);
+        },
+        static_cast<void *>(&instance.instance));
+    ImGui_ImplVulkan_InitInfo init_info = {};
+    init_info.Instance = instance.instance;
+    init_info.PhysicalDevice = physical_device.physical_device;
+    init_info.Device = device.device;
+    init_info.QueueFamily = queue_index;
+    init_info.Queue = queue;
+    init_info.DescriptorPool = descriptor_pool;
+    init_info.MinImageCount = swapchain.image_count;
+    init_info.ImageCount = swapchain.image_count;
+    if (!ImGui_ImplVulkan_Init(&init_info, render_pass)) {
+        return -1;
+    }
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     vkBeginCommandBuffer(command_buffer, &begin_info);
     ImGui_ImplVulkan_CreateFontsTexture(command_buffer);
     VkSubmitInfo end_info = {};
@@ -537,118 +2045,318 @@ std::optional<int> imgui_initialize(
     return {};
 }
 
+const char *get_present_mode_name(const VkPresentModeKHR &present_mode) {
+    switch (present_mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo_relaxed";
+    default:
+        return "unknown";
+    }
+}
+
+std::optional<int> get_present_mode(const char *name,
+                                    VkPresentModeKHR &present_mode) {
+    for (auto mode :
+         {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR,
+          VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR}) {
+        if (!strcmp(name, get_present_mode_name(mode))) {
+            present_mode = mode;
+            return {};
+        }
+    }
+    return -1;
+}
+
+struct FrameStatistics {
+    std::vector<double> latencies;
+    std::vector<double> frame_times;
+    std::vector<double> gpu_times;
+};
+
+void frame_statistics_push(std::vector<double> &samples,
+                           const double &sample) {
+    samples.push_back(sample);
+    if (samples.size() > 4096) {
+        samples.erase(samples.begin());
+    }
+}
+
+void create_frame_statistics(FrameStatistics &statistics) {
+    statistics.latencies.reserve(4097);
+    statistics.frame_times.reserve(4097);
+    statistics.gpu_times.reserve(4097);
+}
+
+double get_percentile(const std::vector<double> &samples,
+                      const double &percentile, std::vector<double> &scratch) {
+    if (samples.empty()) {
+        return 0.;
+    }
+    scratch.assign(samples.begin(), samples.end());
+    auto n = std::min<size_t>(scratch.size() - 1, scratch.size() * percentile);
+    std::nth_element(scratch.begin(), scratch.begin() + n, scratch.end());
+    return scratch[n];
+}
+
+int get_frame_statistics_text(const VkPresentModeKHR &present_mode,
+                              const FrameStatistics &statistics,
+                              std::vector<double> &scratch, char *text,
+                              const size_t &size) {
+    auto latency_50 = get_percentile(statistics.latencies, .5, scratch);
+    auto latency_99 = get_percentile(statistics.latencies, .99, scratch);
+    auto frame_50 = get_percentile(statistics.frame_times, .5, scratch);
+    auto frame_99 = get_percentile(statistics.frame_times, .99, scratch);
+    auto gpu_50 = get_percentile(statistics.gpu_times, .5, scratch);
+    auto gpu_99 = get_percentile(statistics.gpu_times, .99, scratch);
+    return snprintf(text, size,
+                    "%s: latency %.2f/%.2f ms, frame %.2f/%.2f ms, "
+                    "gpu %.3f/%.3f ms (%zu frames)\n",
+                    get_present_mode_name(present_mode), latency_50,
+                    latency_99, frame_50, frame_99, gpu_50, gpu_99,
+                    statistics.frame_times.size());
+}
+
+void hash_combine(uint64_t &hash, const void *data, const size_t &size) {
+    auto bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+}
+
+void damage_union(VkRect2D &damage, const VkRect2D &rect) {
+    if (!rect.extent.width || !rect.extent.height) {
+        return;
+    }
+    if (!damage.extent.width || !damage.extent.height) {
+        damage = rect;
+        return;
+    }
+    auto x0 = std::min(damage.offset.x, rect.offset.x);
+    auto y0 = std::min(damage.offset.y, rect.offset.y);
+    auto x1 = std::max(damage.offset.x + int32_t(damage.extent.width),
+                       rect.offset.x + int32_t(rect.extent.width));
+    auto y1 = std::max(damage.offset.y + int32_t(damage.extent.height),
+                       rect.offset.y + int32_t(rect.extent.height));
+    damage = {.offset = {x0, y0},
+              .extent = {uint32_t(x1 - x0), uint32_t(y1 - y0)}};
+}
+
+// Grows damage to whole work groups so the dispatch rewrites exactly the
+// pixels the render pass clears, clamped to the image
+void damage_align(VkRect2D &damage, const uint3 &local_size,
+                  const VkExtent2D &extent) {
+    if (!damage.extent.width || !damage.extent.height) {
+        return;
+    }
+    auto x0 = damage.offset.x / int32_t(local_size.x) * int32_t(local_size.x);
+    auto y0 = damage.offset.y / int32_t(local_size.y) * int32_t(local_size.y);
+    auto x1 = std::min<uint32_t>(
+        (damage.offset.x + damage.extent.width + local_size.x - 1) /
+            local_size.x * local_size.x,
+        extent.width);
+    auto y1 = std::min<uint32_t>(
+        (damage.offset.y + damage.extent.height + local_size.y - 1) /
+            local_size.y * local_size.y,
+        extent.height);
+    damage = {.offset = {x0, y0},
+              .extent = {x1 - uint32_t(x0), y1 - uint32_t(y0)}};
+}
+
+void get_draw_data_damage(const ImDrawData *draw_data,
+                          const VkExtent2D &extent, uint64_t &hash,
+                          VkRect2D &bounds) {
+    hash = 14695981039346656037ull;
+    bounds = {};
+    for (auto n = 0; n < draw_data->CmdListsCount; ++n) {
+        auto list = draw_data->CmdLists[n];
+        hash_combine(hash, list->VtxBuffer.Data,
+                     list->VtxBuffer.Size * sizeof(ImDrawVert));
+        hash_combine(hash, list->IdxBuffer.Data,
+                     list->IdxBuffer.Size * sizeof(ImDrawIdx));
+        for (auto &command : list->CmdBuffer) {
+            hash_combine(hash, &command.ClipRect, sizeof(command.ClipRect));
+            hash_combine(hash, &command.TextureId, sizeof(command.TextureId));
+            hash_combine(hash, &command.VtxOffset, sizeof(command.VtxOffset));
+            hash_combine(hash, &command.IdxOffset, sizeof(command.IdxOffset));
+            hash_combine(hash, &command.ElemCount, sizeof(command.ElemCount));
+            auto scale = draw_data->FramebufferScale;
+            auto position = draw_data->DisplayPos;
+            auto x0 = std::clamp((command.ClipRect.x - position.x) * scale.x,
+                                 0.f, float(extent.width));
+            auto y0 = std::clamp((command.ClipRect.y - position.y) * scale.y,
+                                 0.f, float(extent.height));
+            auto x1 = std::clamp(
+                std::ceil((command.ClipRect.z - position.x) * scale.x), 0.f,
+                float(extent.width));
+            auto y1 = std::clamp(
+                std::ceil((command.ClipRect.w - position.y) * scale.y), 0.f,
+                float(extent.height));
+            if (x1 > x0 && y1 > y0) {
+                damage_union(bounds,
+                             {.offset = {int32_t(x0), int32_t(y0)},
+                              .extent = {uint32_t(x1) - uint32_t(x0),
+                                         uint32_t(y1) - uint32_t(y0)}});
+            }
+        }
+    }
+}
+
+// The backend sets its own scissor per command, so damage only limits ImGui
+// through the clip rectangles, which the next ImGui::Render rebuilds.
+void clip_draw_data(ImDrawData *draw_data, const VkRect2D &rect) {
+    auto scale = draw_data->FramebufferScale;
+    auto position = draw_data->DisplayPos;
+    auto x0 = rect.offset.x / scale.x + position.x;
+    auto y0 = rect.offset.y / scale.y + position.y;
+    auto x1 = (rect.offset.x + rect.extent.width) / scale.x + position.x;
+    auto y1 = (rect.offset.y + rect.extent.height) / scale.y + position.y;
+    for (auto n = 0; n < draw_data->CmdListsCount; ++n) {
+        for (auto &command : draw_data->CmdLists[n]->CmdBuffer) {
+            command.ClipRect.x = std::max(command.ClipRect.x, x0);
+            command.ClipRect.y = std::max(command.ClipRect.y, y0);
+            command.ClipRect.z = std::min(command.ClipRect.z, x1);
+            command.ClipRect.w = std::min(command.ClipRect.w, y1);
+        }
+    }
+}
+
+template <typename Graphics, typename Compute, typename Key>
 std::optional<int> frame_submit(
     const vkb::Device &device, const VkQueue &graphics_queue,
     const VkQueue &compute_queue, const vkb::Swapchain &swapchain,
-    const std::vector<VkFence> &signal_fences,
+    const std::vector<VkFence> &signal_fences, FrameSerials &serials,
     const std::vector<VkSemaphore> &wait_semaphores,
     const std::vector<VkSemaphore> &signal_semaphores,
+    const std::vector<VkSemaphore> &present_semaphores,
     const std::vector<VkCommandBuffer> &graphics_command_buffers,
     const std::vector<VkCommandBuffer> &compute_command_buffers,
-    uint32_t &index,
-    std::function<std::optional<int>(const uint32_t &, const VkCommandBuffer &)>
-        graphics_commands,
-    std::function<std::optional<int>(const uint32_t &, const VkCommandBuffer &)>
-        compute_commands) {
+    std::vector<uint64_t> &compute_keys, Recorder &recorder,
+    const uint32_t &compute_count, uint32_t &frame, uint32_t &index,
+    Graphics &&graphics_commands, Compute &&compute_commands,
+    Key &&compute_key) {
+    if (vkWaitForFences(device.device, 2, &signal_fences[frame * 2], VK_TRUE,
+                        UINT64_MAX) != VK_SUCCESS) {
+        return -1;
+    }
+    serials.completed[frame] = serials.submitted[frame];
     uint32_t image_index;
     VkResult result =
         vkAcquireNextImageKHR(device.device, swapchain.swapchain, UINT64_MAX,
-                              wait_semaphores[index], nullptr, &image_index);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+                              wait_semaphores[frame], nullptr, &image_index);
+    auto suboptimal = result == VK_SUBOPTIMAL_KHR;
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         return 0;
     } else if (result == VK_NOT_READY || result == VK_TIMEOUT) {
         return 1;
-    } else if (result != VK_SUCCESS) {
-        return -1;
-    }
-    if (vkWaitForFences(device.device, 2, &signal_fences[image_index * 2],
-                        VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+    } else if (result != VK_SUCCESS && !suboptimal) {
         return -1;
     }
-    if (vkResetFences(device.device, 2, &signal_fences[image_index * 2]) !=
+    if (vkResetFences(device.device, 2, &signal_fences[frame * 2]) !=
         VK_SUCCESS) {
         return -1;
     }
-    if (vkResetCommandBuffer(graphics_command_buffers[image_index],
-                             VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT) !=
-        VK_SUCCESS) {
+    serials.submitted[frame] = ++serials.serial;
+    auto &graphics_command_buffer = graphics_command_buffers[frame];
+    if (vkResetCommandBuffer(graphics_command_buffer, 0) != VK_SUCCESS) {
         return -1;
     }
     VkCommandBufferBeginInfo graphics_begin_info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
-    if (vkBeginCommandBuffer(graphics_command_buffers[image_index],
-                             &graphics_begin_info) != VK_SUCCESS) {
+    if (vkBeginCommandBuffer(graphics_command_buffer, &graphics_begin_info) !=
+        VK_SUCCESS) {
         return -1;
     }
-    if (auto error = graphics_commands(image_index,
-                                       graphics_command_buffers[image_index])) {
+    if (auto error = graphics_commands(image_index, graphics_command_buffer)) {
         return -1;
     }
-    if (vkEndCommandBuffer(graphics_command_buffers[image_index]) !=
-        VK_SUCCESS) {
+    if (vkEndCommandBuffer(graphics_command_buffer) != VK_SUCCESS) {
         return -1;
     }
     VkPipelineStageFlags graphics_wait_stages[] = {
-        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT};
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
     VkSubmitInfo graphics_submit_info = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &wait_semaphores[index],
+        .pWaitSemaphores = &wait_semaphores[frame],
         .pWaitDstStageMask = graphics_wait_stages,
         .commandBufferCount = 1,
-        .pCommandBuffers = &graphics_command_buffers[image_index],
+        .pCommandBuffers = &graphics_command_buffer,
         .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &signal_semaphores[image_index * 2 + 0]};
+        .pSignalSemaphores = &signal_semaphores[frame]};
     if (vkQueueSubmit(graphics_queue, 1, &graphics_submit_info,
-                      signal_fences[image_index * 2 + 0]) != VK_SUCCESS) {
-        return -1;
-    }
-    if (vkResetCommandBuffer(compute_command_buffers[image_index],
-                             VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT) !=
-        VK_SUCCESS) {
-        return -1;
-    }
-    VkCommandBufferBeginInfo compute_begin_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
-    if (vkBeginCommandBuffer(compute_command_buffers[image_index],
-                             &compute_begin_info) != VK_SUCCESS) {
-        return -1;
-    }
-    if (auto error = compute_commands(image_index,
-                                      compute_command_buffers[image_index])) {
+                      signal_fences[frame * 2 + 0]) != VK_SUCCESS) {
         return -1;
     }
-    if (vkEndCommandBuffer(compute_command_buffers[image_index]) !=
-        VK_SUCCESS) {
-        return -1;
+    auto &compute_command_buffer = compute_command_buffers[frame];
+    auto key = compute_key(image_index);
+    if (!key || compute_keys[frame] != key) {
+        compute_keys[frame] = 0;
+        if (vkResetCommandBuffer(compute_command_buffer, 0) != VK_SUCCESS) {
+            return -1;
+        }
+        VkCommandBufferBeginInfo compute_begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = 0};
+        if (vkBeginCommandBuffer(compute_command_buffer,
+                                 &compute_begin_info) != VK_SUCCESS) {
+            return -1;
+        }
+        if (auto error = recorder_reset(device, recorder, frame)) {
+            return -1;
+        }
+        if (auto error = recorder_record(
+                device, recorder, frame, compute_count,
+                [&](const uint32_t &i, const VkCommandBuffer &command_buffer)
+                    -> std::optional<int> {
+                    return compute_commands(image_index, i, command_buffer);
+                })) {
+            return -1;
+        }
+        auto &secondary_command_buffers = recorder.recorded[frame];
+        if (!secondary_command_buffers.empty()) {
+            vkCmdExecuteCommands(compute_command_buffer,
+                                 secondary_command_buffers.size(),
+                                 secondary_command_buffers.data());
+        }
+        if (vkEndCommandBuffer(compute_command_buffer) != VK_SUCCESS) {
+            return -1;
+        }
+        compute_keys[frame] = key;
     }
     VkPipelineStageFlags compute_wait_stages[] = {
-        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT};
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
     VkSubmitInfo compute_submit_info = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &signal_semaphores[image_index * 2 + 0],
+        .pWaitSemaphores = &signal_semaphores[frame],
         .pWaitDstStageMask = compute_wait_stages,
         .commandBufferCount = 1,
-        .pCommandBuffers = &compute_command_buffers[image_index],
+        .pCommandBuffers = &compute_command_buffer,
         .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &signal_semaphores[image_index * 2 + 1]};
+        .pSignalSemaphores = &present_semaphores[image_index]};
     if (vkQueueSubmit(compute_queue, 1, &compute_submit_info,
-                      signal_fences[image_index * 2 + 1]) != VK_SUCCESS) {
+                      signal_fences[frame * 2 + 1]) != VK_SUCCESS) {
         return -1;
     }
     VkPresentInfoKHR present_info = {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &signal_semaphores[image_index * 2 + 1],
+        .pWaitSemaphores = &present_semaphores[image_index],
         .swapchainCount = 1,
         .pSwapchains = &swapchain.swapchain,
         .pImageIndices = &image_index};
     result = vkQueuePresentKHR(graphics_queue, &present_info);
     index = image_index;
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+    frame = (frame + 1) % wait_semaphores.size();
+    if (suboptimal || result == VK_ERROR_OUT_OF_DATE_KHR ||
+        result == VK_SUBOPTIMAL_KHR) {
         return 0;
     } else if (result != VK_SUCCESS) {
         return -1;
@@ -14,10 +14,11 @@ template <typename T> struct prefix_exclusive_sum_t4 {
 #ifndef VK_ZERO_CPU
 
 __kernel void device_kernel(read_write image2d_t output,
-                            __constant MainConstants *constants) {
+                            __constant MainConstants *constants,
+                            uint2 offset) {
     int2 dimensions = get_image_dim(output);
-    int x = static_cast<int>(get_global_id(0));
-    int y = static_cast<int>(get_global_id(1));
+    int x = static_cast<int>(get_global_id(0) + offset.x);
+    int y = static_cast<int>(get_global_id(1) + offset.y);
     if (x >= dimensions.x || y >= dimensions.y)
         return;
     float4 pixel = read_imagef(output, ivec2(x, y));
@@ -0,0 +1,288 @@
+#include "primitives.hpp"
+
+struct PrimitivesOperation {
+    const char *name;
+    bool exclusive, segmented, reduce;
+};
+
+int main(int argc, char *argv[]) {
+    uint64_t length = argc > 1 ? std::stoull(argv[1]) : 1 << 24;
+    if (length == 0 || length > UINT32_MAX) {
+        return -1;
+    }
+    std::vector<uint32_t> input(length), heads(length), output(length),
+        reference(length);
+    uint32_t seed = 1;
+    for (uint64_t i = 0; i < length; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = seed >> 8;
+        heads[i] = (seed & 0xff) == 0;
+    }
+    PrimitivesOperation operations[] = {
+        {"inclusive scan", false, false, false},
+        {"exclusive scan", true, false, false},
+        {"segmented scan", false, true, false},
+        {"reduce", false, false, true}};
+    auto host = [&]() -> int {
+        for (auto &operation : operations) {
+            if (operation.reduce) {
+                std::cout << operation.name << ": "
+                          << primitives::reduce_host(input.data(), length)
+                          << "\n";
+            } else {
+                primitives::scan_host(
+                    input.data(), operation.segmented ? heads.data() : nullptr,
+                    reference.data(), length, operation.exclusive);
+                std::cout << operation.name << ": " << reference[length - 1]
+                          << "\n";
+            }
+        }
+        return 0;
+    };
+    if (auto error = initialize(true)) {
+        return host();
+    }
+    auto create_name = "primitives";
+    vkb::Instance instance;
+    if (auto error = create_instance_headless(create_name, instance)) {
+        return host();
+    }
+    vkb::PhysicalDevice physical_device;
+    vkb::Device device;
+    VmaAllocator allocator;
+    if (auto error = create_device_allocator(instance, VK_NULL_HANDLE,
+                                             physical_device, device,
+                                             allocator)) {
+        return host();
+    }
+    VkQueue compute_queue;
+    uint32_t compute_queue_index;
+    if (auto error =
+            get_compute_queue(device, compute_queue, compute_queue_index)) {
+        return -1;
+    }
+    VkCommandPool command_pool;
+    if (auto error =
+            create_command_pool(device, compute_queue_index, command_pool)) {
+        return -1;
+    }
+    VkDescriptorPool descriptor_pool;
+    if (auto error = create_descriptor_pool(device, descriptor_pool)) {
+        return -1;
+    }
+    VkDescriptorSetLayout set_layout;
+    VkPipelineLayout pipeline_layout;
+    if (auto error = primitives::create_set_pipeline_layout(
+            device, set_layout, pipeline_layout)) {
+        return -1;
+    }
+    auto &limits = physical_device.properties.limits;
+    uint3 local_size = uvec3(
+        std::min({uint32_t{PRIMITIVES_MAX_LOCAL_SIZE},
+                  limits.maxComputeWorkGroupSize[0],
+                  limits.maxComputeWorkGroupInvocations}),
+        1, 1);
+    auto module_name = "primitives.hpp";
+    VkShaderModule shader_module;
+    if (auto error = create_shader_module(device, module_name, shader_module)) {
+        return -1;
+    }
+    auto cache_name = "primitives.cache";
+    VkPipelineCache pipeline_cache;
+    bool pipeline_cache_hit;
+    if (auto error =
+            create_pipeline_cache(physical_device, device, cache_name,
+                                  pipeline_cache, pipeline_cache_hit)) {
+        return -1;
+    }
+    auto scan_name = "primitives_scan_kernel";
+    auto reduce_name = "primitives_reduce_kernel";
+    VkPipeline scan_pipeline, reduce_pipeline;
+    if (auto error = create_pipeline(device, pipeline_cache, pipeline_layout,
+                                     shader_module, local_size, scan_name,
+                                     scan_pipeline)) {
+        return -1;
+    }
+    if (auto error = create_pipeline(device, pipeline_cache, pipeline_layout,
+                                     shader_module, local_size, reduce_name,
+                                     reduce_pipeline)) {
+        return -1;
+    }
+    auto partitions = primitives::get_partition_count(length, local_size);
+    auto size = length * sizeof(uint32_t);
+    auto state_size = primitives::get_state_size(partitions);
+    if (std::max<VkDeviceSize>(size, state_size) >
+        limits.maxStorageBufferRange) {
+        return -1;
+    }
+    std::vector<uint32_t> queue_indices{compute_queue_index};
+    std::array<VkBuffer, 5> buffers;
+    std::array<VmaAllocation, 5> allocations;
+    std::array<VmaAllocationInfo, 5> allocation_infos;
+    std::array<VkDeviceSize, 5> sizes{size, size, size, state_size, 16};
+    for (auto i = 0; i < buffers.size(); ++i) {
+        if (auto error = create_buffer_device(
+                allocator, sizes[i], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                queue_indices, buffers[i], allocations[i],
+                allocation_infos[i])) {
+            return -1;
+        }
+    }
+    auto &[buffer_input, buffer_heads, buffer_output, buffer_state,
+           buffer_result] = buffers;
+    VkDescriptorSet scan_set, reduce_set;
+    if (auto error = primitives::allocate_descriptor_set(
+            device, {buffer_input, buffer_heads, buffer_output, buffer_state},
+            set_layout, descriptor_pool, scan_set)) {
+        return -1;
+    }
+    if (auto error = primitives::allocate_descriptor_set(
+            device, {buffer_input, buffer_result, buffer_output, buffer_state},
+            set_layout, descriptor_pool, reduce_set)) {
+        return -1;
+    }
+    StagingRing staging_ring;
+    if (auto error = create_staging_ring(
+            device, allocator, compute_queue_index, 2,
+            std::min<VkDeviceSize>(size, 32 << 20), staging_ring)) {
+        return -1;
+    }
+    if (auto error = staging_upload(device, compute_queue, staging_ring,
+                                    input.data(), size, buffer_input, 0)) {
+        return -1;
+    }
+    if (auto error = staging_upload(device, compute_queue, staging_ring,
+                                    heads.data(), size, buffer_heads, 0)) {
+        return -1;
+    }
+    if (auto error = staging_finish(device, compute_queue, staging_ring)) {
+        return -1;
+    }
+    std::vector<VkCommandBuffer> command_buffers;
+    if (auto error = allocate_command_buffers(device, command_pool, 1,
+                                              command_buffers)) {
+        return -1;
+    }
+    std::vector<VkFence> fences;
+    if (auto error = create_fences(device, 1, fences)) {
+        return -1;
+    }
+    Profiler profiler;
+    auto profiling = !create_profiler(physical_device, device,
+                                      compute_queue_index, 16, profiler);
+    auto &command_buffer = command_buffers[0];
+    auto &fence = fences[0];
+    for (auto &operation : operations) {
+        if (vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX) !=
+                VK_SUCCESS ||
+            vkResetFences(device.device, 1, &fence) != VK_SUCCESS ||
+            vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
+            return -1;
+        }
+        VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            return -1;
+        }
+        PrimitivesConstants constants{
+            .length = static_cast<uint32_t>(length),
+            .partitions = partitions,
+            .exclusive = operation.exclusive,
+            .segmented = operation.segmented};
+        uint64_t bytes = operation.reduce      ? size
+                         : operation.segmented ? size * 3
+                                               : size * 2;
+        uint32_t region;
+        if (profiling) {
+            profiler_begin(profiler, command_buffer, operation.name, bytes,
+                           region);
+        }
+        primitives::record_primitive(
+            command_buffer,
+            operation.reduce ? reduce_pipeline : scan_pipeline,
+            pipeline_layout, operation.reduce ? reduce_set : scan_set,
+            operation.reduce ? buffer_result : buffer_state,
+            operation.reduce ? sizeof(uint32_t) : state_size, constants,
+            limits.maxComputeWorkGroupCount[0]);
+        if (profiling) {
+            profiler_end(profiler, command_buffer, region);
+        }
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            return -1;
+        }
+        VkSubmitInfo submit_info = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                                    .commandBufferCount = 1,
+                                    .pCommandBuffers = &command_buffer};
+        if (vkQueueSubmit(compute_queue, 1, &submit_info, fence) !=
+            VK_SUCCESS) {
+            return -1;
+        }
+        if (profiling) {
+            profiler_submit(profiler, fence);
+        }
+        if (auto error = staging_download(
+                device, compute_queue, staging_ring,
+                operation.reduce ? buffer_result : buffer_output, 0,
+                operation.reduce ? sizeof(uint32_t) : size, output.data())) {
+            return -1;
+        }
+        if (auto error = staging_finish(device, compute_queue, staging_ring)) {
+            return -1;
+        }
+        if (vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX) !=
+            VK_SUCCESS) {
+            return -1;
+        }
+        bool valid;
+        if (operation.reduce) {
+            valid = output[0] == primitives::reduce_host(input.data(), length);
+        } else {
+            primitives::scan_host(
+                input.data(), operation.segmented ? heads.data() : nullptr,
+                reference.data(), length, operation.exclusive);
+            valid = output == reference;
+        }
+        std::cout << operation.name << ": " << (valid ? "ok" : "mismatch");
+        if (profiling) {
+            auto resolved = profiler.results.size();
+            if (auto error = profiler_resolve(device, profiler)) {
+                return -1;
+            }
+            if (profiler.results.size() > resolved) {
+                auto duration = profiler.results.back().duration;
+                std::cout << ", " << duration / 1e3 << " ms, "
+                          << (duration > 0. ? bytes / duration / 1e3 : 0.)
+                          << " GB/s";
+            }
+        }
+        std::cout << "\n";
+        if (!valid) {
+            return -1;
+        }
+    }
+    if (profiling) {
+        destroy_profiler(device, profiler);
+    }
+    vkDestroyFence(device.device, fence, nullptr);
+    vkFreeCommandBuffers(device.device, command_pool, command_buffers.size(),
+                         command_buffers.data());
+    destroy_staging_ring(device, allocator, staging_ring);
+    VkDescriptorSet descriptor_sets[] = {scan_set, reduce_set};
+    vkFreeDescriptorSets(device.device, descriptor_pool, 2, descriptor_sets);
+    for (auto i = 0; i < buffers.size(); ++i) {
+        vmaDestroyBuffer(allocator, buffers[i], allocations[i]);
+    }
+    vkDestroyPipeline(device.device, reduce_pipeline, nullptr);
+    vkDestroyPipeline(device.device, scan_pipeline, nullptr);
+    destroy_pipeline_cache(device, cache_name, pipeline_cache);
+    vkDestroyShaderModule(device.device, shader_module, nullptr);
+    vkDestroyPipelineLayout(device.device, pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(device.device, set_layout, nullptr);
+    vkDestroyDescriptorPool(device.device, descriptor_pool, nullptr);
+    vkDestroyCommandPool(device.device, command_pool, nullptr);
+    vmaDestroyAllocator(allocator);
+    vkb::destroy_device(device);
+    vkb::destroy_instance(instance);
+    return 0;
+}
@@ -0,0 +1,159 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include "main.h"
+
+#ifdef VK_ZERO_CPU
+
+#else
+
+#endif
+
+#define PRIMITIVES_ITEMS 4
+#define PRIMITIVES_MAX_LOCAL_SIZE 256
+
+#define PRIMITIVES_AGGREGATE 1u
+#define PRIMITIVES_PREFIX 2u
+#define PRIMITIVES_HEAD 4u
+
+struct PrimitivesConstants {
+    uint32_t length;
+    uint32_t partitions;
+    uint32_t exclusive;
+    uint32_t segmented;
+};
+
+#ifdef VK_ZERO_CPU
+
+namespace primitives {
+uint32_t get_partition_count(const uint64_t &length, const uint3 &local_size) {
+    uint64_t partition_length = local_size.x * PRIMITIVES_ITEMS;
+    return static_cast<uint32_t>((length + partition_length - 1) /
+                                 partition_length);
+}
+
+VkDeviceSize get_state_size(const uint32_t &partitions) {
+    return (1 + VkDeviceSize{partitions} * 3) * sizeof(uint32_t);
+}
+
+std::optional<int>
+create_set_pipeline_layout(const vkb::Device &device,
+                           VkDescriptorSetLayout &set_layout,
+                           VkPipelineLayout &pipeline_layout) {
+    std::vector<VkDescriptorSetLayoutBinding> bindings{4};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i] = {.binding = i,
+                       .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                       .descriptorCount = 1,
+                       .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                       .pImmutableSamplers = nullptr};
+    }
+    VkDescriptorSetLayoutCreateInfo set_create_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .bindingCount = (uint32_t)bindings.size(),
+        .pBindings = bindings.data()};
+    if (vkCreateDescriptorSetLayout(device.device, &set_create_info, nullptr,
+                                    &set_layout) != VK_SUCCESS) {
+        return -1;
+    }
+    VkPushConstantRange push_constant_range{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(PrimitivesConstants)};
+    VkPipelineLayoutCreateInfo pipeline_create_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = &set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range};
+    if (vkCreatePipelineLayout(device.device, &pipeline_create_info, nullptr,
+                               &pipeline_layout) != VK_SUCCESS) {
+        return -1;
+    }
+    return {};
+}
+
+std::optional<int>
+allocate_descriptor_set(const vkb::Device &device,
+                        const std::array<VkBuffer, 4> &buffers,
+                        const VkDescriptorSetLayout &set_layout,
+                        const VkDescriptorPool &descriptor_pool,
+                        VkDescriptorSet &descriptor_set) {
+    VkDescriptorSetAllocateInfo allocate_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &set_layout};
+    if (vkAllocateDescriptorSets(device.device, &allocate_info,
+                                 &descriptor_set) != VK_SUCCESS) {
+        return -1;
+    }
+    std::array<VkDescriptorBufferInfo, 4> buffer_info;
+    std::array<VkWriteDescriptorSet, 4> descriptor_writes;
+    for (uint32_t i = 0; i < 4; ++i) {
+        buffer_info[i] = {
+            .buffer = buffers[i], .offset = 0, .range = VK_WHOLE_SIZE};
+        descriptor_writes[i] = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = descriptor_set,
+            .dstBinding = i,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = nullptr,
+            .pBufferInfo = &buffer_info[i],
+            .pTexelBufferView = nullptr};
+    }
+    vkUpdateDescriptorSets(device.device, descriptor_writes.size(),
+                           descriptor_writes.data(), 0, nullptr);
+    return {};
+}
+
+void record_primitive(const VkCommandBuffer &command_buffer,
+                      const VkPipeline &pipeline,
+                      const VkPipelineLayout &pipeline_layout,
+                      const VkDescriptorSet &descriptor_set,
+                      const VkBuffer &state, const VkDeviceSize &state_size,
+                      const PrimitivesConstants &constants,
+                      const uint32_t &max_group_count) {
+    vkCmdFillBuffer(command_buffer, state, 0, state_size, 0);
+    VkMemoryBarrier memory_barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &memory_barrier, 0, nullptr, 0, nullptr);
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipeline_layout, 0, 1, &descriptor_set, 0,
+                            nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    // Kernels loop over the remaining partitions when this is clamped
+    vkCmdDispatch(command_buffer,
+                  std::min(constants.partitions, max_group_count), 1, 1);
+    memory_barrier = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                      .pNext = nullptr,
+                      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                      .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT |
+                                       VK_ACCESS_TRANSFER_WRITE_BIT};
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+                         &memory_barrier, 0, nullptr, 0, nullptr);
+}
+} // namespace primitives
+
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef PRIMITIVES_HPP
+#define PRIMITIVES_HPP
+
+#include "primitives.h"
+
+#ifndef VK_ZERO_CPU
+
+__kernel void primitives_scan_kernel(__global uint32_t *input,
+                                     __global uint32_t *heads,
+                                     __global uint32_t *output,
+                                     __global uint32_t *state,
+                                     PrimitivesConstants constants) {
+    __local uint32_t values[PRIMITIVES_MAX_LOCAL_SIZE];
+    __local uint32_t flags[PRIMITIVES_MAX_LOCAL_SIZE];
+    __local uint32_t shared[2];
+    uint32_t local_id = get_local_id(0);
+    uint32_t local_size = get_local_size(0);
+    __global uint32_t *status = state + 1;
+    __global uint32_t *aggregates = status + constants.partitions;
+    __global uint32_t *prefixes = aggregates + constants.partitions;
+    // The dispatch may be smaller than the partition count, so each group
+    // keeps taking tickets until every partition has been scanned
+    while (true) {
+        if (local_id == 0)
+            shared[0] = atomic_inc(&state[0]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+        uint32_t partition = shared[0];
+        if (partition >= constants.partitions)
+            break;
+        uint64_t first =
+            (static_cast<uint64_t>(partition) * local_size + local_id) *
+            PRIMITIVES_ITEMS;
+        uint32_t items[PRIMITIVES_ITEMS];
+        uint32_t item_heads[PRIMITIVES_ITEMS];
+        uint32_t sum = 0;
+        uint32_t head = 0;
+        for (uint32_t k = 0; k < PRIMITIVES_ITEMS; ++k) {
+            uint64_t i = first + k;
+            items[k] = i < constants.length ? input[i] : 0;
+            item_heads[k] = constants.segmented && i < constants.length &&
+                                    heads[i]
+                                ? 1
+                                : 0;
+            sum = item_heads[k] ? items[k] : sum + items[k];
+            head |= item_heads[k];
+        }
+        values[local_id] = sum;
+        flags[local_id] = head;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (uint32_t offset = 1; offset < local_size; offset <<= 1) {
+            uint32_t value = values[local_id];
+            uint32_t flag = flags[local_id];
+            if (local_id >= offset) {
+                value = flag ? value : values[local_id - offset] + value;
+                flag |= flags[local_id - offset];
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+            values[local_id] = value;
+            flags[local_id] = flag;
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+        if (local_id == 0) {
+            uint32_t aggregate = values[local_size - 1];
+            uint32_t aggregate_head = flags[local_size - 1];
+            uint32_t exclusive = 0;
+            if (partition != 0) {
+                atomic_xchg(&aggregates[partition], aggregate);
+                mem_fence(CLK_GLOBAL_MEM_FENCE);
+                atomic_xchg(&status[partition],
+                            PRIMITIVES_AGGREGATE |
+                                (aggregate_head ? PRIMITIVES_HEAD : 0));
+                uint32_t exclusive_head = 0;
+                uint32_t look = partition - 1;
+                while (true) {
+                    uint32_t look_status = atomic_or(&status[look], 0);
+                    if (look_status == 0)
+                        continue;
+                    mem_fence(CLK_GLOBAL_MEM_FENCE);
+                    // Atomic reads so a published value is never served stale
+                    uint32_t look_value =
+                        look_status & PRIMITIVES_PREFIX
+                            ? atomic_or(&prefixes[look], 0)
+                            : atomic_or(&aggregates[look], 0);
+                    exclusive =
+                        exclusive_head ? exclusive : look_value + exclusive;
+                    exclusive_head |= look_status & PRIMITIVES_HEAD;
+                    if (look_status & PRIMITIVES_PREFIX || exclusive_head ||
+                        look == 0)
+                        break;
+                    --look;
+                }
+            }
+            atomic_xchg(&prefixes[partition],
+                        aggregate_head ? aggregate : exclusive + aggregate);
+            mem_fence(CLK_GLOBAL_MEM_FENCE);
+            atomic_xchg(&status[partition], PRIMITIVES_PREFIX);
+            shared[1] = exclusive;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        uint32_t running = shared[1];
+        if (local_id != 0)
+            running = flags[local_id - 1] ? values[local_id - 1]
+                                          : running + values[local_id - 1];
+        for (uint32_t k = 0; k < PRIMITIVES_ITEMS; ++k) {
+            uint64_t i = first + k;
+            if (i >= constants.length)
+                break;
+            if (item_heads[k])
+                running = 0;
+            output[i] = constants.exclusive ? running : running + items[k];
+            running += items[k];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+__kernel void primitives_reduce_kernel(__global uint32_t *input,
+                                       __global uint32_t *output,
+                                       PrimitivesConstants constants) {
+    __local uint32_t values[PRIMITIVES_MAX_LOCAL_SIZE];
+    uint32_t local_id = get_local_id(0);
+    uint32_t local_size = get_local_size(0);
+    uint32_t sum = 0;
+    // Stride over partitions in case the dispatch was clamped to the limit
+    for (uint32_t partition = get_group_id(0);
+         partition < constants.partitions; partition += get_num_groups(0)) {
+        uint64_t first =
+            static_cast<uint64_t>(partition) * local_size * PRIMITIVES_ITEMS;
+        for (uint32_t k = 0; k < PRIMITIVES_ITEMS; ++k) {
+            uint64_t i = first + k * local_size + local_id;
+            sum += i < constants.length ? input[i] : 0;
+        }
+    }
+    values[local_id] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint32_t stride = 1; stride < local_size; stride <<= 1) {
+        if (local_id % (stride * 2) == 0 && local_id + stride < local_size)
+            values[local_id] += values[local_id + stride];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (local_id == 0)
+        atomic_add(&output[0], values[0]);
+}
+
+#endif
+
+#ifdef VK_ZERO_CPU
+
+namespace primitives {
+inline void scan_host(const uint32_t *input, const uint32_t *heads,
+                      uint32_t *output, const uint64_t &length,
+                      const bool &exclusive) {
+    uint32_t running = 0;
+    for (uint64_t i = 0; i < length; ++i) {
+        if (heads && heads[i]) {
+            running = 0;
+        }
+        output[i] = exclusive ? running : running + input[i];
+        running += input[i];
+    }
+}
+
+inline uint32_t reduce_host(const uint32_t *input, const uint64_t &length) {
+    uint32_t sum = 0;
+    for (uint64_t i = 0; i < length; ++i) {
+        sum += input[i];
+    }
+    return sum;
+}
+} // namespace primitives
+
+#endif
+
+#endif
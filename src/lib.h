@@ -3,12 +3,20 @@
 
 #ifdef VK_ZERO_CPU
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
@@ -51,9 +59,222 @@ using namespace glm;
 #define __global
 #define __constant const
 
-inline static uint32_t GLOBAL_ID[3]{0, 0, 0};
+inline thread_local uint32_t GLOBAL_ID[3]{0, 0, 0};
+inline thread_local uint32_t LOCAL_ID[3]{0, 0, 0};
+inline thread_local uint32_t GROUP_ID[3]{0, 0, 0};
+inline thread_local uint32_t LOCAL_SIZE[3]{1, 1, 1};
+inline thread_local uint32_t NUM_GROUPS[3]{1, 1, 1};
+inline thread_local uint32_t WORKER_INDEX = 0;
 
 inline uint32_t get_global_id(uint32_t dimindx) { return GLOBAL_ID[dimindx]; }
+inline uint32_t get_local_id(uint32_t dimindx) { return LOCAL_ID[dimindx]; }
+inline uint32_t get_group_id(uint32_t dimindx) { return GROUP_ID[dimindx]; }
+inline uint32_t get_local_size(uint32_t dimindx) { return LOCAL_SIZE[dimindx]; }
+inline uint32_t get_num_groups(uint32_t dimindx) { return NUM_GROUPS[dimindx]; }
+inline uint32_t get_global_size(uint32_t dimindx) {
+    return NUM_GROUPS[dimindx] * LOCAL_SIZE[dimindx];
+}
+
+struct WorkStealingPool {
+    struct alignas(64) Range {
+        std::mutex mutex;
+        uint64_t begin = 0;
+        uint64_t end = 0;
+    };
+
+    uint32_t worker_count;
+    std::unique_ptr<Range[]> ranges;
+    std::vector<std::thread> threads;
+    std::mutex dispatch_mutex;
+    std::mutex mutex;
+    std::condition_variable start_condition;
+    std::condition_variable done_condition;
+    uint64_t generation = 0;
+    uint32_t running = 0;
+    bool stop = false;
+    uint64_t grain = 1;
+    void (*job)(void *, uint64_t, uint64_t) = nullptr;
+    void *context = nullptr;
+
+    inline static thread_local WorkStealingPool *current = nullptr;
+
+    explicit WorkStealingPool(uint32_t count)
+        : worker_count(std::max(count, 1u)),
+          ranges(std::make_unique<Range[]>(worker_count)) {
+        for (uint32_t i = 1; i < worker_count; ++i) {
+            threads.emplace_back([this, i]() { loop(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard lock{mutex};
+            stop = true;
+        }
+        start_condition.notify_all();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    void loop(uint32_t index) {
+        WORKER_INDEX = index;
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock lock{mutex};
+                start_condition.wait(
+                    lock, [&]() { return stop || generation != seen; });
+                if (stop) {
+                    return;
+                }
+                seen = generation;
+            }
+            work(index);
+            {
+                std::lock_guard lock{mutex};
+                if (--running == 0) {
+                    done_condition.notify_all();
+                }
+            }
+        }
+    }
+
+    bool take(uint32_t index, uint64_t &begin, uint64_t &end) {
+        auto &range = ranges[index];
+        std::lock_guard lock{range.mutex};
+        if (range.begin == range.end) {
+            return false;
+        }
+        begin = range.begin;
+        end = std::min(range.begin + grain, range.end);
+        range.begin = end;
+        return true;
+    }
+
+    bool steal(uint32_t index) {
+        for (uint32_t offset = 1; offset < worker_count; ++offset) {
+            auto &victim = ranges[(index + offset) % worker_count];
+            uint64_t begin, end;
+            {
+                std::lock_guard lock{victim.mutex};
+                if (victim.begin == victim.end) {
+                    continue;
+                }
+                begin = victim.begin + (victim.end - victim.begin) / 2;
+                end = victim.end;
+                victim.end = begin;
+            }
+            auto &range = ranges[index];
+            std::lock_guard lock{range.mutex};
+            range.begin = begin;
+            range.end = end;
+            return true;
+        }
+        return false;
+    }
+
+    void work(uint32_t index) {
+        auto previous = current;
+        current = this;
+        uint64_t begin, end;
+        while (take(index, begin, end) || (steal(index) &&
+                                           take(index, begin, end))) {
+            job(context, begin, end);
+        }
+        current = previous;
+    }
+
+    void run(uint64_t count, uint64_t chunk,
+             void (*function)(void *, uint64_t, uint64_t), void *data) {
+        if (count == 0) {
+            return;
+        }
+        if (current == this || worker_count == 1) {
+            function(data, 0, count);
+            return;
+        }
+        std::lock_guard dispatch_lock{dispatch_mutex};
+        job = function;
+        context = data;
+        grain = std::max(chunk, uint64_t{1});
+        for (uint32_t i = 0; i < worker_count; ++i) {
+            std::lock_guard lock{ranges[i].mutex};
+            ranges[i].begin = count * i / worker_count;
+            ranges[i].end = count * (i + 1) / worker_count;
+        }
+        {
+            std::lock_guard lock{mutex};
+            running = worker_count - 1;
+            ++generation;
+        }
+        start_condition.notify_all();
+        work(0);
+        std::unique_lock lock{mutex};
+        done_condition.wait(lock, [&]() { return running == 0; });
+    }
+};
+
+inline WorkStealingPool &get_work_stealing_pool() {
+    static WorkStealingPool pool{[]() {
+        if (auto threads = std::getenv("VK_ZERO_CPU_THREADS")) {
+            return static_cast<uint32_t>(std::strtoul(threads, nullptr, 10));
+        }
+        return std::thread::hardware_concurrency();
+    }()};
+    return pool;
+}
+
+template <typename F>
+void parallel_for(uint64_t count, uint64_t grain, F &&function) {
+    get_work_stealing_pool().run(
+        count, grain,
+        [](void *data, uint64_t begin, uint64_t end) {
+            (*static_cast<std::remove_reference_t<F> *>(data))(begin, end);
+        },
+        static_cast<void *>(&function));
+}
+
+// Work-items of a group run one after another on a single thread, so kernels
+// dispatched here must not use barriers, __local memory or atomics.
+template <typename Kernel, typename... Args>
+std::optional<int> dispatch(Kernel &&kernel, const uint3 &global_size,
+                            const uint3 &local_size, Args &&...args) {
+    if (!local_size.x || !local_size.y || !local_size.z) {
+        return -1;
+    }
+    uint3 num_groups = (global_size + local_size - 1u) / local_size;
+    parallel_for(
+        static_cast<uint64_t>(num_groups.x) * num_groups.y * num_groups.z, 1,
+        [&](uint64_t begin, uint64_t end) {
+            for (auto d = 0; d < 3; ++d) {
+                LOCAL_SIZE[d] = local_size[d];
+                NUM_GROUPS[d] = num_groups[d];
+            }
+            for (auto group = begin; group < end; ++group) {
+                GROUP_ID[0] = static_cast<uint32_t>(group % num_groups.x);
+                GROUP_ID[1] = static_cast<uint32_t>(group / num_groups.x %
+                                                    num_groups.y);
+                GROUP_ID[2] = static_cast<uint32_t>(
+                    group / num_groups.x / num_groups.y);
+                for (LOCAL_ID[2] = 0; LOCAL_ID[2] < local_size.z;
+                     ++LOCAL_ID[2]) {
+                    for (LOCAL_ID[1] = 0; LOCAL_ID[1] < local_size.y;
+                         ++LOCAL_ID[1]) {
+                        for (LOCAL_ID[0] = 0; LOCAL_ID[0] < local_size.x;
+                             ++LOCAL_ID[0]) {
+                            for (auto d = 0; d < 3; ++d) {
+                                GLOBAL_ID[d] = GROUP_ID[d] * LOCAL_SIZE[d] +
+                                               LOCAL_ID[d];
+                            }
+                            kernel(args...);
+                        }
+                    }
+                }
+            }
+        });
+    return {};
+}
 
 #else
 
@@ -79,4 +300,93 @@ inline uint32_t get_global_id(uint32_t dimindx) { return GLOBAL_ID[dimindx]; }
 
 #endif
 
+template <typename E> struct expression_t {
+    E e;
+
+    auto operator[](uint64_t i) const { return e[i]; }
+};
+
+template <typename T> struct scalar_t {
+    T value;
+
+    T operator[](uint64_t i) const { return value; }
+};
+
+template <uint64_t width, typename P> struct load_t {
+    P pointer;
+    uint64_t offset;
+
+    auto operator[](uint64_t i) const {
+        return pointer[(i + offset) / width].element[(i + offset) % width];
+    }
+};
+
+struct add_t {
+    template <typename L, typename R>
+    static auto apply(const L &l, const R &r) {
+        return l + r;
+    }
+};
+
+struct sub_t {
+    template <typename L, typename R>
+    static auto apply(const L &l, const R &r) {
+        return l - r;
+    }
+};
+
+struct mul_t {
+    template <typename L, typename R>
+    static auto apply(const L &l, const R &r) {
+        return l * r;
+    }
+};
+
+template <typename O, typename L, typename R> struct binary_t {
+    L l;
+    R r;
+
+    auto operator[](uint64_t i) const { return O::apply(l[i], r[i]); }
+};
+
+template <uint64_t width, typename P>
+expression_t<load_t<width, P>> expression_load(P pointer,
+                                               uint64_t offset = 0) {
+    return {{pointer, offset}};
+}
+
+template <typename T> expression_t<scalar_t<T>> expression_scalar(T value) {
+    return {{value}};
+}
+
+template <typename L, typename R>
+expression_t<binary_t<add_t, L, R>> operator+(const expression_t<L> &l,
+                                              const expression_t<R> &r) {
+    return {{l.e, r.e}};
+}
+
+template <typename L, typename R>
+expression_t<binary_t<sub_t, L, R>> operator-(const expression_t<L> &l,
+                                              const expression_t<R> &r) {
+    return {{l.e, r.e}};
+}
+
+template <typename L, typename R>
+expression_t<binary_t<mul_t, L, R>> operator*(const expression_t<L> &l,
+                                              const expression_t<R> &r) {
+    return {{l.e, r.e}};
+}
+
+template <typename L, typename T>
+expression_t<binary_t<mul_t, L, scalar_t<T>>>
+operator*(const expression_t<L> &l, const T &r) {
+    return {{l.e, {r}}};
+}
+
+template <typename T, typename R>
+expression_t<binary_t<mul_t, scalar_t<T>, R>>
+operator*(const T &l, const expression_t<R> &r) {
+    return {{{l}, r.e}};
+}
+
 #endif